@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
@@ -100,6 +102,16 @@ struct OffScreenDestroy { };
 /// Screen Bound component
 struct ScreenBound { };
 
+/// Instanced Sprite component,
+/// drawn together with all other instances sharing its texture and render layer
+struct InstancedSprite { };
+
+/// Render Layer component
+struct RenderLayer {
+  uint8_t index = 0;  // index into the scene's layers, drawn in order
+  uint16_t depth = 0; // order within the layer, objects of equal depth may be drawn in any order
+};
+
 /// Delay Erasing component
 struct DelayErasing {
   bool sound = true;
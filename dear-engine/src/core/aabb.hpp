@@ -2,6 +2,7 @@
 
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
+#include <glm/common.hpp>
 #include <glm/mat4x4.hpp>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -22,6 +23,19 @@ struct Aabb {
     glm::vec2 b = matrix * glm::vec4(max, 0.0f, 1.0f);
     return Aabb{glm::min(a, b), glm::max(a, b)};
   }
+
+  /// Smallest box containing both this box and other
+  Aabb merge(const Aabb& other) const {
+    return Aabb{glm::min(min, other.min), glm::max(max, other.max)};
+  }
+
+  /// Axis-aligned bounds of this box transformed by matrix, rotation included
+  Aabb bounds(const glm::mat4& matrix) const {
+    const glm::vec2 center = matrix * glm::vec4((min + max) * 0.5f, 0.0f, 1.0f);
+    const glm::vec2 half_size = (max - min) * 0.5f;
+    const glm::vec2 extent = glm::abs(glm::vec2(matrix[0])) * half_size.x + glm::abs(glm::vec2(matrix[1])) * half_size.y;
+    return Aabb{center - extent, center + extent};
+  }
 };
 
 /// Check for collision between two AABBs
@@ -0,0 +1,42 @@
+#include "alloc_stats.hpp"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Allocation Stats
+
+static std::atomic<size_t> g_alloc_count {0};
+static std::atomic<size_t> g_alloc_bytes {0};
+
+/// Snapshot the global heap allocation counters
+auto alloc_stats() -> AllocStats
+{
+  return {
+    .count = g_alloc_count.load(std::memory_order_relaxed),
+    .bytes = g_alloc_bytes.load(std::memory_order_relaxed),
+  };
+}
+
+// Replacement of the global allocation functions, the array and nothrow variants forward to these.
+// Relaxed atomics keep the counting overhead to a couple of uncontended increments per allocation.
+
+void* operator new(std::size_t size)
+{
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Allocation Stats
+
+/// Counters of global heap allocations (operator new) since program start
+struct AllocStats {
+  size_t count = 0; // number of allocations
+  size_t bytes = 0; // total bytes requested
+};
+
+/// Snapshot the global heap allocation counters
+auto alloc_stats() -> AllocStats;
@@ -0,0 +1,99 @@
+#include "cached_layer.hpp"
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <glm/common.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "log.hpp"
+#include "gl_state.hpp"
+#include "renderer.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Cached Layer
+
+CachedLayer::~CachedLayer()
+{
+  gl_release(GLKind::FRAMEBUFFER, fbo_);
+}
+
+/// Prepare to draw content within bounds, returns false when the cached content is up to date
+bool CachedLayer::begin(const Camera& camera, const Viewport& viewport, const Aabb& bounds, uint64_t key)
+{
+  // Snap bounds outwards to the viewport's pixels
+  const Aabb view = camera.visible_rect();
+  const glm::vec2 pixels_per_unit = glm::vec2(viewport.size) / (view.max - view.min);
+  const glm::vec2 min_px = glm::floor((bounds.min - view.min) * pixels_per_unit);
+  const glm::vec2 max_px = glm::max(glm::ceil((bounds.max - view.min) * pixels_per_unit), min_px + 1.0f);
+  const Aabb snapped = { .min = view.min + min_px / pixels_per_unit, .max = view.min + max_px / pixels_per_unit };
+  const glm::uvec2 size = glm::uvec2(max_px - min_px);
+  if (valid_ && key == key_ && size == size_ && snapped.min == bounds_.min && snapped.max == bounds_.max)
+    return false;
+
+  valid_ = true;
+  key_ = key;
+  size_ = size;
+  bounds_ = snapped;
+  camera_ = Camera::create(snapped);
+  reserve(size);
+  gl_state().bind_framebuffer(GL_FRAMEBUFFER, fbo_);
+  gl_state().viewport(0, 0, size.x, size.y);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  // Color is weighted by alpha as usual, alpha accumulates coverage, leaving color premultiplied by it
+  gl_state().enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  return true;
+}
+
+/// Finish drawing the content
+void CachedLayer::end(const Viewport& viewport)
+{
+  gl_state().bind_framebuffer(GL_FRAMEBUFFER, 0);
+  gl_state().viewport(viewport.offset.x, viewport.offset.y, viewport.size.x, viewport.size.y);
+  gl_state().enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+/// Queue the quad compositing the content in the sprite batch and flush it
+void CachedLayer::draw(const GLShader& shader, SpriteBatch& batch) const
+{
+  if (!valid_ || !texture_) return;
+  const glm::vec2 center = (bounds_.min + bounds_.max) * 0.5f;
+  const glm::vec2 half_size = (bounds_.max - bounds_.min) * 0.5f;
+  const glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(center, 0.0f)), glm::vec3(half_size, 1.0f));
+  const glm::vec4 texrect = { 0.0f, 0.0f, (float)size_.x / capacity_.x, (float)size_.y / capacity_.y };
+  GLState& state = gl_state();
+  state.enable_blend(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  batch.draw(shader, *texture_, model, texrect);
+  batch.flush();
+  state.enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+/// Grow the texture storage to fit size pixels
+void CachedLayer::reserve(glm::uvec2 size)
+{
+  if (texture_ && size.x <= capacity_.x && size.y <= capacity_.y) return;
+  capacity_ = glm::max(size, capacity_);
+  GLuint texture;
+  glGenTextures(1, &texture);
+  gl_state().bind_texture(0, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  // Composited 1:1 with the viewport's pixels
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, capacity_.x, capacity_.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  texture_.reset();
+  texture_ = GLTexture{ texture };
+
+  if (!fbo_) {
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    fbo_ = fbo;
+  }
+  gl_state().bind_framebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+    ERROR("Cached layer framebuffer incomplete ({}x{}, status {:#x})", capacity_.x, capacity_.y, (unsigned)status);
+  DEBUG("Cached layer [{}] storage grown to {}x{}", fbo_, capacity_.x, capacity_.y);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <glm/vec2.hpp>
+
+#include "aabb.hpp"
+#include "camera.hpp"
+#include "viewport.hpp"
+#include "gl_texture.hpp"
+#include "unique_num.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Cached Layer
+
+/// CachedLayer keeps content that rarely changes, like static labels and overlays, rendered in a texture and
+/// composites it with a single textured quad. Its content is redrawn only after invalidate(), or when the key
+/// describing it (e.g. a version or hash of what is drawn), its bounds or the viewport change.
+/// The texture covers just the content's bounds, snapped to the viewport's pixels so the quad samples it 1:1,
+/// and holds premultiplied alpha, so blended content composites the same as drawing it directly.
+class CachedLayer final {
+ public:
+  CachedLayer() = default;
+  ~CachedLayer();
+
+  // Movable but not Copyable
+  CachedLayer(CachedLayer&&) = default;
+  CachedLayer(const CachedLayer&) = delete;
+  CachedLayer& operator=(CachedLayer&&) = default;
+  CachedLayer& operator=(const CachedLayer&) = delete;
+
+  /// Redraw the content on the next begin()
+  void invalidate() { valid_ = false; }
+
+  /// Prepare to draw content within bounds, in the space of camera drawn to viewport, described by key.
+  /// Returns false when the cached content is up to date. Otherwise binds the layer's framebuffer cleared, sets
+  /// blending to accumulate premultiplied alpha and returns true: draw the content with camera() and call end().
+  bool begin(const Camera& camera, const Viewport& viewport, const Aabb& bounds, uint64_t key);
+
+  /// Camera to draw the content with between begin() and end()
+  [[nodiscard]] const Camera& camera() const { return camera_; }
+
+  /// Finish drawing the content, rebinding the default framebuffer with viewport and the default blending
+  void end(const Viewport& viewport);
+
+  /// Queue the quad compositing the content in the sprite batch and flush it, with the camera passed to begin()
+  /// set on the bound GLSub::TEXTURE variant of the generic shader
+  void draw(const class GLShader& shader, class SpriteBatch& batch) const;
+
+ private:
+  /// Grow the texture storage to fit size pixels
+  void reserve(glm::uvec2 size);
+
+ private:
+  UniqueNum<GLuint> fbo_;
+  std::optional<GLTexture> texture_;
+  glm::uvec2 capacity_ = glm::uvec2(0); // texture storage size
+  glm::uvec2 size_ = glm::uvec2(0);     // pixels used by the content, from the bottom-left corner
+  Aabb bounds_;                         // content bounds snapped to pixels
+  Camera camera_;
+  uint64_t key_ = 0;
+  bool valid_ = false;
+};
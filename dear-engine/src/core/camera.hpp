@@ -1,26 +1,79 @@
 #pragma once
 
+#include <glm/vec2.hpp>
+#include <glm/common.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "aabb.hpp"
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Camera
 
+/// Orthographic camera that pans and zooms over the world.
+/// Normalized view space spans (-aspect_ratio, -1) to (+aspect_ratio, +1), like the cursor's normalized position.
 struct Camera {
   glm::mat4 projection;
   glm::mat4 view;
+  glm::vec2 position = glm::vec2(0.0f); // world point at the center of the view
+  float zoom = 1.0f;                    // view scale, above 1 zooms in
+  float aspect_ratio = 1.0f;
+
+  /// Zoom limits
+  static constexpr float kMinZoom = 0.25f;
+  static constexpr float kMaxZoom = 8.0f;
 
   /// Create Orthographic Camera
   static Camera create(float aspect_ratio) {
-    const float zoom_level = 1.0f;
-    const float rotation = 0.0f;
-    return {
-      .projection = glm::ortho(-aspect_ratio * zoom_level, +aspect_ratio * zoom_level, -zoom_level, +zoom_level, +1.0f, -1.0f),
-      .view = glm::inverse(glm::rotate(glm::mat4(1.0f), glm::radians(rotation), glm::vec3(0, 0, 1))),
+    auto camera = Camera{
+      .projection = glm::ortho(-aspect_ratio, +aspect_ratio, -1.0f, +1.0f, +1.0f, -1.0f),
+      .view = glm::mat4(1.0f),
+      .position = glm::vec2(0.0f),
+      .zoom = 1.0f,
+      .aspect_ratio = aspect_ratio,
     };
+    camera.update_view();
+    return camera;
+  }
+
+  /// Create Orthographic Camera viewing exactly rect
+  static Camera create(const Aabb& rect) {
+    const glm::vec2 half_size = (rect.max - rect.min) * 0.5f;
+    auto camera = create(half_size.x / half_size.y);
+    camera.position = (rect.min + rect.max) * 0.5f;
+    camera.zoom = 1.0f / half_size.y;
+    camera.update_view();
+    return camera;
+  }
+
+  /// Move the view by delta in world units
+  void pan(const glm::vec2& delta) {
+    position += delta;
+    update_view();
+  }
+
+  /// Scale the zoom by factor, keeping the world point under anchor (in normalized view space) in place
+  void zoom_by(float factor, const glm::vec2& anchor = glm::vec2(0.0f)) {
+    const glm::vec2 world = to_world(anchor);
+    zoom = glm::clamp(zoom * factor, kMinZoom, kMaxZoom);
+    position = world - anchor / zoom;
+    update_view();
+  }
+
+  /// Convert a point from normalized view space to world space
+  [[nodiscard]] glm::vec2 to_world(const glm::vec2& normalized) const { return position + normalized / zoom; }
+
+  /// World space rectangle seen by the camera
+  [[nodiscard]] Aabb visible_rect() const {
+    const glm::vec2 half_size = glm::vec2(aspect_ratio, 1.0f) / zoom;
+    return Aabb{ .min = position - half_size, .max = position + half_size };
+  }
+
+  /// Recompute the view matrix from position and zoom
+  void update_view() {
+    view = glm::scale(glm::mat4(1.0f), glm::vec3(zoom, zoom, 1.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-position, 0.0f));
   }
 };
 
 /// Upload camera matrix to shader
 void set_camera(const class GLShader& shader, const Camera& camera);
-
@@ -0,0 +1,94 @@
+#include "debug_draw.hpp"
+
+#include <cmath>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "renderer.hpp"
+#include "gl_shader.hpp"
+#include "stream_buffer.hpp"
+#include "profiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Debug Draw
+
+/// Queue a line from a to b
+void DebugDraw::line(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color)
+{
+  const glm::u8vec4 color8 = pack_color(color);
+  lines_.emplace_back(ColorVertex{ .pos = a, .color = color8 });
+  lines_.emplace_back(ColorVertex{ .pos = b, .color = color8 });
+}
+
+/// Queue the outline of a box
+void DebugDraw::box(const Aabb& aabb, const glm::vec4& color)
+{
+  box(aabb, glm::mat4(1.0f), color);
+}
+
+/// Queue the outline of a box transformed by model
+void DebugDraw::box(const Aabb& aabb, const glm::mat4& model, const glm::vec4& color)
+{
+  const glm::vec2 corners[4] = {
+    model * glm::vec4(aabb.max.x, aabb.max.y, 0.0f, 1.0f),
+    model * glm::vec4(aabb.max.x, aabb.min.y, 0.0f, 1.0f),
+    model * glm::vec4(aabb.min.x, aabb.min.y, 0.0f, 1.0f),
+    model * glm::vec4(aabb.min.x, aabb.max.y, 0.0f, 1.0f),
+  };
+  for (int i = 0; i < 4; i++)
+    line(corners[i], corners[(i + 1) % 4], color);
+}
+
+/// Queue a filled box
+void DebugDraw::filled_box(const Aabb& aabb, const glm::vec4& color)
+{
+  const glm::u8vec4 color8 = pack_color(color);
+  const ColorVertex a = { .pos = { aabb.max.x, aabb.max.y }, .color = color8 };
+  const ColorVertex b = { .pos = { aabb.max.x, aabb.min.y }, .color = color8 };
+  const ColorVertex c = { .pos = { aabb.min.x, aabb.min.y }, .color = color8 };
+  const ColorVertex d = { .pos = { aabb.min.x, aabb.max.y }, .color = color8 };
+  triangles_.insert(triangles_.end(), { a, b, d, b, c, d });
+}
+
+/// Queue the outline of a circle
+void DebugDraw::circle(const glm::vec2& center, float radius, const glm::vec4& color, int segments)
+{
+  const float step = glm::two_pi<float>() / (float)segments;
+  glm::vec2 prev = center + glm::vec2(radius, 0.0f);
+  for (int i = 1; i <= segments; i++) {
+    const glm::vec2 next = center + radius * glm::vec2(std::cos(step * i), std::sin(step * i));
+    line(prev, next, color);
+    prev = next;
+  }
+}
+
+/// Queue an arrow from a to b, with a head at b
+void DebugDraw::arrow(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color, float head_size)
+{
+  line(a, b, color);
+  const glm::vec2 dir = b - a;
+  const float length = glm::length(dir);
+  if (length <= 0.0f) return;
+  const glm::vec2 back = dir * (head_size / length);
+  const glm::vec2 side = glm::vec2(-back.y, back.x) * 0.5f;
+  line(b, b - back + side, color);
+  line(b, b - back - side, color);
+}
+
+/// Stream all shapes queued in debug and draw them, lines first then filled shapes
+void draw_debug(const GLShader& shader, StreamBuffer& stream, const GLObject& glo, const DebugDraw& debug)
+{
+  PROFILE_ZONE("draw_debug");
+  const glm::mat4 model = glm::mat4(1.0f); // vertices are already in world space
+  if (!debug.lines().empty()) {
+    if (auto offset = stream.write<ColorVertex>(debug.lines()))
+      draw_colored_arrays(shader, glo, GL_LINES, *offset / sizeof(ColorVertex), debug.lines().size(), model);
+  }
+  if (!debug.triangles().empty()) {
+    if (auto offset = stream.write<ColorVertex>(debug.triangles()))
+      draw_colored_arrays(shader, glo, GL_TRIANGLES, *offset / sizeof(ColorVertex), debug.triangles().size(), model);
+  }
+}
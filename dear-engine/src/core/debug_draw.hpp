@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <gsl/span>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "aabb.hpp"
+#include "gl_object.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Debug Draw
+
+/// DebugDraw accumulates debug lines and shapes in world space, to be drawn all at once by draw_debug():
+/// every outline in one GL_LINES call and every filled shape in one GL_TRIANGLES call.
+/// It holds no GL objects, so one thread can fill it while another draws it, and clear() keeps its memory
+/// for the next frame.
+class DebugDraw final {
+ public:
+  /// Segments used for circles when not given
+  static constexpr int kCircleSegments = 24;
+
+  /// Queue a line from a to b
+  void line(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color);
+
+  /// Queue the outline of a box
+  void box(const Aabb& aabb, const glm::vec4& color);
+
+  /// Queue the outline of a box transformed by model, so it follows the object's rotation
+  void box(const Aabb& aabb, const glm::mat4& model, const glm::vec4& color);
+
+  /// Queue a filled box
+  void filled_box(const Aabb& aabb, const glm::vec4& color);
+
+  /// Queue the outline of a circle
+  void circle(const glm::vec2& center, float radius, const glm::vec4& color, int segments = kCircleSegments);
+
+  /// Queue an arrow from a to b, with a head of head_size length at b
+  void arrow(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color, float head_size = 0.05f);
+
+  /// Drop all queued shapes, keeping the memory
+  void clear() {
+    lines_.clear();
+    triangles_.clear();
+  }
+
+  /// Check if there is nothing queued
+  [[nodiscard]] bool empty() const { return lines_.empty() && triangles_.empty(); }
+
+  /// Queued line vertices, two per line
+  [[nodiscard]] auto lines() const -> gsl::span<const ColorVertex> { return lines_; }
+
+  /// Queued triangle vertices, three per triangle
+  [[nodiscard]] auto triangles() const -> gsl::span<const ColorVertex> { return triangles_; }
+
+ private:
+  std::vector<ColorVertex> lines_;
+  std::vector<ColorVertex> triangles_;
+};
+
+/// Stream all shapes queued in debug and draw them in world space with the camera already set,
+/// with the GLSub::COLOR variant of the generic shader bound and glo a colored object over the stream buffer
+void draw_debug(const class GLShader& shader, class StreamBuffer& stream, const GLObject& glo, const DebugDraw& debug);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <cstddef>
+#include <condition_variable>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Frame Stream
+
+/// FrameStream hands frames from a producer thread to a consumer thread through a ring of N reusable slots.
+/// The producer fills a slot while the consumer works on an older one, so with N=2 one frame is produced while
+/// the previous is consumed, and N=3 lets the producer run one more frame ahead.
+/// Slots are handed out in order and never reallocated, so frames can keep their buffers' capacity.
+template<typename Frame, size_t N = 2>
+class FrameStream final {
+  static_assert(N >= 2, "a single slot can't be written and read at the same time");
+
+ public:
+  FrameStream() = default;
+
+  // Not Copyable or Movable, threads hold on to it
+  FrameStream(const FrameStream&) = delete;
+  FrameStream& operator=(const FrameStream&) = delete;
+
+  /// Get the next slot for writing if one is free, without waiting. Returns null when full or closed.
+  Frame* try_begin_write() {
+    std::lock_guard lock(mutex_);
+    if (closed_ || written_ - read_ >= N) return nullptr;
+    return &slots_[written_ % N];
+  }
+
+  /// Wait for the next slot to be free and get it for writing. Returns null once closed.
+  Frame* begin_write() {
+    std::unique_lock lock(mutex_);
+    cond_.wait(lock, [this] { return closed_ || written_ - read_ < N; });
+    return closed_ ? nullptr : &slots_[written_ % N];
+  }
+
+  /// Publish the slot got from begin_write to the consumer
+  void end_write() {
+    { std::lock_guard lock(mutex_); written_++; }
+    cond_.notify_all();
+  }
+
+  /// Wait for the next published slot and get it for reading. Returns null once closed and all slots were read.
+  Frame* begin_read() {
+    std::unique_lock lock(mutex_);
+    cond_.wait(lock, [this] { return closed_ || read_ < written_; });
+    return read_ < written_ ? &slots_[read_ % N] : nullptr;
+  }
+
+  /// Release the slot got from begin_read back to the producer
+  void end_read() {
+    { std::lock_guard lock(mutex_); read_++; }
+    cond_.notify_all();
+  }
+
+  /// Stop handing out slots for writing and wake up both threads, the consumer still gets the published ones
+  void close() {
+    { std::lock_guard lock(mutex_); closed_ = true; }
+    cond_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::array<Frame, N> slots_;
+  size_t written_ = 0; // slots published so far
+  size_t read_ = 0;    // slots released so far
+  bool closed_ = false;
+};
@@ -1,51 +1,58 @@
 #include "./gl_font.hpp"
 
 #include <string>
+#include <memory>
 #include <optional>
 
-#include <stb/stb_rect_pack.h>
 #include <stb/stb_truetype.h>
 
 #include "log.hpp"
 #include "file.hpp"
-#include "gl_texture.hpp"
 
 using namespace std::string_literals;
 
-/// Read font file and upload generated bitmap texture to GPU memory
+/// Read and parse a font file, scaled to the given pixel height
+static auto read_font(const std::string& fontname, float pixel_height) -> std::optional<GLFont>
+{
+  static uint32_t next_id = 0;
+  const std::string filepath = ENGINE_ASSETS_PATH + "/fonts/"s + fontname;
+  auto data = read_file_to_string(filepath);
+  if (!data) { ERROR("Failed to load font '{}'", fontname); return std::nullopt; }
+  auto file = std::make_shared<const std::string>(std::move(*data));
+  const auto* bytes = (const unsigned char*)file->data();
+  stbtt_fontinfo info;
+  if (!stbtt_InitFont(&info, bytes, stbtt_GetFontOffsetForIndex(bytes, 0))) {
+    ERROR("Failed to parse font '{}'", fontname);
+    return std::nullopt;
+  }
+  return GLFont{
+    .id = next_id++,
+    .file = std::move(file),
+    .info = info,
+    // Same scale as STBTT_POINT_SIZE, the em square is pixel_height tall
+    .scale = stbtt_ScaleForMappingEmToPixels(&info, pixel_height),
+    .pixel_height = pixel_height,
+  };
+}
+
+/// Read font file for glyphs rasterized as coverage bitmaps
 auto load_font(const std::string& fontname) -> std::optional<GLFont>
 {
   DEBUG("Loading Font {}", fontname);
-  const std::string filepath = ENGINE_ASSETS_PATH + "/fonts/"s + fontname;
-  auto font = read_file_to_string(filepath);
-  if (!font) { ERROR("Failed to load font '{}'", fontname); return std::nullopt; }
-  constexpr int kStride = 0;
-  constexpr int kPadding = 2;
-  constexpr unsigned int kOversampling = 2;
   constexpr float kPixelHeight = 22.0;
-  constexpr int kCharBeg = 32;
-  constexpr int kCharEnd = 128;
-  constexpr int kCharCount = kCharEnd - kCharBeg;
-  const int bitmap_pixel_size = std::sqrt(kPixelHeight * kPixelHeight * (2.f/3.f) * kCharCount) * kOversampling;
-  auto bitmap = std::make_unique<uint8_t[]>(bitmap_pixel_size * bitmap_pixel_size);
-  stbtt_pack_context pack_ctx;
-  stbtt_packedchar packed_chars[kCharCount];
-  stbtt_PackBegin(&pack_ctx, bitmap.get(), bitmap_pixel_size, bitmap_pixel_size, kStride, kPadding, nullptr);
-  stbtt_PackSetOversampling(&pack_ctx, kOversampling, kOversampling);
-  int ret = stbtt_PackFontRange(&pack_ctx, (const uint8_t*)font->data(), 0, STBTT_POINT_SIZE(kPixelHeight), kCharBeg, kCharCount, packed_chars);
-  if (ret <= 0) WARN("Font '{}': Some characters may not have fit in the font bitmap!", fontname);
-  stbtt_PackEnd(&pack_ctx);
-  std::vector<stbtt_packedchar> chars;
-  chars.reserve(kCharCount);
-  std::copy_n(packed_chars, kCharCount, std::back_inserter(chars));
-  GLTexture texture = load_font_texture(bitmap.get(), bitmap_pixel_size, bitmap_pixel_size);
-  return GLFont{ 
-    .texture = std::move(texture),
-    .bitmap_px_width = bitmap_pixel_size,
-    .bitmap_px_height = bitmap_pixel_size,
-    .char_beg = kCharBeg,
-    .char_count = kCharCount,
-    .chars = std::move(chars),
-    .pixel_height = kPixelHeight,
-  };
+  constexpr int kOversampling = 2;
+  auto font = read_font(fontname, kPixelHeight);
+  if (font) font->oversampling = kOversampling;
+  return font;
+}
+
+/// Read font file for glyphs rasterized as signed distance fields
+auto load_sdf_font(const std::string& fontname) -> std::optional<GLFont>
+{
+  DEBUG("Loading SDF Font {}", fontname);
+  constexpr float kPixelHeight = 48.0;
+  constexpr float kSpread = 6.0; // texels of distance encoded each side of the edge
+  auto font = read_font(fontname, kPixelHeight);
+  if (font) font->sdf_spread = kSpread;
+  return font;
 }
@@ -1,26 +1,32 @@
 #pragma once
 
-#include <stb/stb_truetype.h>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <optional>
 
-#include "gl_texture.hpp"
+#include <stb/stb_truetype.h>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Font
 
-/// Holds the a font bitmap texture and info needed to render char quads
+/// Holds a parsed font file and the info needed to rasterize its glyphs on demand into the GlyphCache
 struct GLFont {
-  GLTexture texture;
-  int bitmap_px_width;
-  int bitmap_px_height;
-  int char_beg;
-  int char_count;
-  std::vector<stbtt_packedchar> chars;
+  uint32_t id;                             // unique per loaded font, keys its glyphs in the GlyphCache
+  std::shared_ptr<const std::string> file; // font file data, referenced by info
+  stbtt_fontinfo info;
+  float scale;             // font units to pixels at pixel_height
   float pixel_height;
+  int oversampling = 1;    // bitmap glyphs are rasterized this many times larger than pixel_height
+  float sdf_spread = 0.0f; // distance in texels from the glyph edge to 0 or 1 in SDF glyphs, zero for coverage bitmaps
 };
 
 /// GLFont reference type alias
 using GLFontRef = std::shared_ptr<GLFont>;
 
-/// Read font file and upload generated bitmap texture to GPU memory
+/// Read font file for glyphs rasterized as coverage bitmaps
 auto load_font(const std::string& fontname) -> std::optional<GLFont>;
 
+/// Read font file for glyphs rasterized as signed distance fields.
+/// The edge of glyphs is at 0.5, so one texture sample gives crisp text, outlines and glows at any scale.
+auto load_sdf_font(const std::string& fontname) -> std::optional<GLFont>;
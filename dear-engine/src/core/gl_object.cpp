@@ -3,46 +3,120 @@
 #include <glbinding/gl33core/gl.h>
 using namespace gl;
 
+#include "gl_state.hpp"
 #include "gl_shader.hpp"
 
+/// Disable a vertex attribute the shader variant may not have, GL rejects its location of -1 then
+static void disable_attrib(const GLShader& shader, GLAttr attr)
+{
+  const GLint loc = shader.attr_loc(attr);
+  if (loc >= 0) glDisableVertexAttribArray(loc);
+}
+
+/// Point the colored vertex attributes at the buffer bound to GL_ARRAY_BUFFER
+static void set_colored_attribs(const GLShader& shader)
+{
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::POSITION));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::POSITION), 2, GL_FLOAT, GL_FALSE, sizeof(ColorVertex), (void*) offsetof(ColorVertex, pos));
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::COLOR));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::COLOR), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ColorVertex), (void*) offsetof(ColorVertex, color));
+  disable_attrib(shader, GLAttr::TEXCOORD);
+}
+
+/// Point the textured vertex attributes at the buffer bound to GL_ARRAY_BUFFER
+static void set_textured_attribs(const GLShader& shader)
+{
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::POSITION));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::POSITION), 2, GL_FLOAT, GL_FALSE, sizeof(TextureVertex), (void*) offsetof(TextureVertex, pos));
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::TEXCOORD));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::TEXCOORD), 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(TextureVertex), (void*) offsetof(TextureVertex, texcoord));
+  disable_attrib(shader, GLAttr::COLOR);
+}
+
+/// Point the packed textured vertex attributes at the buffer bound to GL_ARRAY_BUFFER
+static void set_packed_textured_attribs(const GLShader& shader)
+{
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::POSITION));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::POSITION), 2, GL_SHORT, GL_TRUE, sizeof(PackedTextureVertex), (void*) offsetof(PackedTextureVertex, pos));
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::TEXCOORD));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::TEXCOORD), 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedTextureVertex), (void*) offsetof(PackedTextureVertex, texcoord));
+  disable_attrib(shader, GLAttr::COLOR);
+}
+
+/// Create the VAO of an object sourcing vertices from vbo, with its own element buffer when there are indices
+static GLObject create_globject_over(const GLShader& shader, GLuint vbo, gsl::span<const GLushort> indices, GLenum usage,
+                                     void (*set_attribs)(const GLShader&))
+{
+  GLuint vao, ebo = 0;
+  glGenVertexArrays(1, &vao);
+  gl_state().bind_vertex_array(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  set_attribs(shader);
+  if (!indices.empty()) {
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), usage);
+  }
+  return { 0, ebo, vao, (size_t)indices.size(), 0 };
+}
+
 /// Upload new Colored Indexed-Vertex object to GPU memory
 GLObject create_colored_globject(const GLShader& shader, gsl::span<const ColorVertex> vertices, gsl::span<const GLushort> indices, GLenum usage)
 {
-  GLuint vbo, ebo, vao;
+  GLuint vbo;
   glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), usage);
-  glEnableVertexAttribArray(shader.attr_loc(GLAttr::POSITION));
-  glVertexAttribPointer(shader.attr_loc(GLAttr::POSITION), 2, GL_FLOAT, GL_FALSE, sizeof(ColorVertex), (void*) offsetof(ColorVertex, pos));
-  glEnableVertexAttribArray(shader.attr_loc(GLAttr::COLOR));
-  glVertexAttribPointer(shader.attr_loc(GLAttr::COLOR), 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex), (void*) offsetof(ColorVertex, color));
-  glDisableVertexAttribArray(shader.attr_loc(GLAttr::TEXCOORD));
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), usage);
-  return { vbo, ebo, vao, indices.size(), vertices.size() };
+  GLObject glo = create_globject_over(shader, vbo, indices, usage, set_colored_attribs);
+  glo.vbo = vbo;
+  glo.num_vertices = vertices.size();
+  return glo;
 }
 
 /// Upload new Textured Indexed-Vertex object to GPU memory
 GLObject create_textured_globject(const GLShader& shader, gsl::span<const TextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage)
 {
-  GLuint vbo, ebo, vao;
+  GLuint vbo;
   glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), usage);
-  glEnableVertexAttribArray(shader.attr_loc(GLAttr::POSITION));
-  glVertexAttribPointer(shader.attr_loc(GLAttr::POSITION), 2, GL_FLOAT, GL_FALSE, sizeof(TextureVertex), (void*) offsetof(TextureVertex, pos));
-  glEnableVertexAttribArray(shader.attr_loc(GLAttr::TEXCOORD));
-  glVertexAttribPointer(shader.attr_loc(GLAttr::TEXCOORD), 2, GL_FLOAT, GL_FALSE, sizeof(TextureVertex), (void*) offsetof(TextureVertex, texcoord));
-  glDisableVertexAttribArray(shader.attr_loc(GLAttr::COLOR));
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), usage);
-  return { vbo, ebo, vao, indices.size(), vertices.size() };
+  GLObject glo = create_globject_over(shader, vbo, indices, usage, set_textured_attribs);
+  glo.vbo = vbo;
+  glo.num_vertices = vertices.size();
+  return glo;
+}
+
+/// Upload new Textured Indexed-Vertex object, with packed vertices within the unit quad, to GPU memory
+GLObject create_textured_globject(const GLShader& shader, gsl::span<const PackedTextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage)
+{
+  GLuint vbo;
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), usage);
+  GLObject glo = create_globject_over(shader, vbo, indices, usage, set_packed_textured_attribs);
+  glo.vbo = vbo;
+  glo.num_vertices = vertices.size();
+  return glo;
+}
+
+/// Create a Colored object whose vertices live in a buffer owned elsewhere
+GLObject create_colored_globject(const GLShader& shader, GLuint vbo, gsl::span<const GLushort> indices)
+{
+  return create_globject_over(shader, vbo, indices, GL_STATIC_DRAW, set_colored_attribs);
+}
+
+/// Create a Textured object whose vertices live in a buffer owned elsewhere
+GLObject create_textured_globject(const GLShader& shader, GLuint vbo, gsl::span<const GLushort> indices)
+{
+  return create_globject_over(shader, vbo, indices, GL_STATIC_DRAW, set_textured_attribs);
+}
+
+/// Create an object without vertices nor indices, owning only a VAO
+GLObject create_empty_globject()
+{
+  GLuint vao;
+  glGenVertexArrays(1, &vao);
+  return { 0, 0, vao, 0, 0 };
 }
 
 /// Upload new colored Quad object to GPU memory
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 
 #include <glbinding/gl33core/gl.h>
 using namespace gl;
@@ -9,25 +10,75 @@ using namespace gl;
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/type_precision.hpp>
 
+#include "gl_state.hpp"
 #include "gl_shader.hpp"
 #include "unique_num.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// GLObjects
 
+// Vertex attributes are packed as small as their range allows and expanded to floats by the GL on fetch:
+// colors are RGBA8 and texture coordinates, always within [0,1], are 16-bit unsigned normalized.
+// Positions stay floats where they're in world space, snorm16 only in meshes within the unit quad.
+
 /// Vertex representation for a Colored Object
 struct ColorVertex {
   glm::vec2 pos;
-  glm::vec4 color;
+  glm::u8vec4 color; // RGBA, normalized
 };
 
 /// Vertex representation for a Textured Object
 struct TextureVertex {
   glm::vec2 pos;
-  glm::vec2 texcoord;
+  glm::u16vec2 texcoord; // normalized
+};
+
+/// Vertex representation for a Textured Object in model space, within the unit quad (-1,-1 to +1,+1)
+struct PackedTextureVertex {
+  glm::i16vec2 pos;      // normalized, see pack_unit_position()
+  glm::u16vec2 texcoord; // normalized
+};
+
+/// Per-instance attributes of an instanced sprite
+struct SpriteInstance {
+  glm::vec2 model[3];   // 2D affine transform columns: X axis, Y axis, origin
+  glm::u16vec4 texrect; // texture coordinates rect (s0, t0, s1, t1) sampled by the unit quad, normalized
+  glm::u8vec4 tint;     // RGBA color multiplied with the texture, normalized
+};
+
+/// Per-instance attributes of a batched text Glyph, in world space with its text's style
+struct GlyphInstance {
+  glm::vec2 model[3];        // 2D affine transform of the unit square (0,0 to 1,1) to the glyph's quad in world space
+  glm::u16vec4 texrect;      // texture coordinates rect (s0, t0, s1, t1) of the glyph in its page, normalized
+  glm::u8vec4 color;         // RGBA, normalized
+  glm::u8vec4 outline_color; // RGBA, normalized
+  float outline_thickness;   // in font texels
 };
 
+/// Pack a color within [0,1] to RGBA8
+inline glm::u8vec4 pack_color(const glm::vec4& color)
+{
+  return glm::u8vec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+/// Pack a texture coordinates rect (s0, t0, s1, t1) within [0,1] to unsigned normalized 16-bit
+inline glm::u16vec4 pack_texrect(const glm::vec4& texrect)
+{
+  return glm::u16vec4(glm::clamp(texrect, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+/// Pack a position within [-1,+1] to signed normalized 16-bit. Only -1 and +1 read back exactly under both
+/// the GL 3.3 snorm rule, (2c+1)/(2^16-1), and the later one, max(c/(2^15-1), -1): they're packed as -32768
+/// and 32767. Values in between, 0 included, are off by up to 1/65535 under the GL 3.3 rule.
+inline constexpr glm::i16vec2 pack_unit_position(const glm::vec2& pos)
+{
+  const auto pack = [](float v) { return (int16_t)(v < 0.0f ? v * 32768.0f : v * 32767.0f); };
+  return { pack(pos.x), pack(pos.y) };
+}
+
 /// Represents an object loaded to GPU memory that's renderable using indices
 struct GLObject {
   UniqueNum<GLuint> vbo;
@@ -37,9 +88,10 @@ struct GLObject {
   size_t num_vertices;
 
   ~GLObject() {
-    if (vbo) glDeleteBuffers(1, &vbo.inner);
-    if (ebo) glDeleteBuffers(1, &ebo.inner);
-    if (vao) glDeleteVertexArrays(1, &vao.inner);
+    // The last reference may be dropped by the game thread, the deletion then waits for the render thread
+    gl_release(GLKind::BUFFER, vbo);
+    gl_release(GLKind::BUFFER, ebo);
+    gl_release(GLKind::VERTEX_ARRAY, vao);
   }
 
   // Movable but not Copyable
@@ -58,6 +110,20 @@ GLObject create_colored_globject(const GLShader& shader, gsl::span<const ColorVe
 /// Upload new Textured Indexed-Vertex object to GPU memory
 GLObject create_textured_globject(const GLShader& shader, gsl::span<const TextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage = GL_STATIC_DRAW);
 
+/// Upload new Textured Indexed-Vertex object, with packed vertices within the unit quad, to GPU memory
+GLObject create_textured_globject(const GLShader& shader, gsl::span<const PackedTextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage = GL_STATIC_DRAW);
+
+/// Create a Colored object whose vertices live in a buffer owned elsewhere (e.g. a StreamBuffer), which must outlive it.
+/// Only the VAO and the element buffer, when there are indices, are owned by the object; num_vertices is zero.
+GLObject create_colored_globject(const GLShader& shader, GLuint vbo, gsl::span<const GLushort> indices);
+
+/// Create a Textured object whose vertices live in a buffer owned elsewhere, see the colored overload
+GLObject create_textured_globject(const GLShader& shader, GLuint vbo, gsl::span<const GLushort> indices);
+
+/// Create an object without vertices nor indices, owning only a VAO, for shaders generating their vertices from
+/// gl_VertexID. Per-instance attributes may be set up on its VAO.
+GLObject create_empty_globject();
+
 // Quad Vertices:
 // (-1,+1)       (+1,+1)
 //  Y ^ - - - - - - o
@@ -73,17 +139,17 @@ GLObject create_textured_globject(const GLShader& shader, gsl::span<const Textur
 // positive Z goes through screen towards you
 
 inline constexpr ColorVertex kColorQuadVertices[] = {
-  { .pos = { +1.0f, +1.0f }, .color = { 0.0f, 0.0f, 1.0f, 1.0f } },
-  { .pos = { +1.0f, -1.0f }, .color = { 0.0f, 1.0f, 0.0f, 1.0f } },
-  { .pos = { -1.0f, -1.0f }, .color = { 1.0f, 0.0f, 0.0f, 1.0f } },
-  { .pos = { -1.0f, +1.0f }, .color = { 1.0f, 0.0f, 1.0f, 1.0f } },
+  { .pos = { +1.0f, +1.0f }, .color = { 0, 0, 255, 255 } },
+  { .pos = { +1.0f, -1.0f }, .color = { 0, 255, 0, 255 } },
+  { .pos = { -1.0f, -1.0f }, .color = { 255, 0, 0, 255 } },
+  { .pos = { -1.0f, +1.0f }, .color = { 255, 0, 255, 255 } },
 };
 
-inline constexpr TextureVertex kTextureQuadVertices[] = {
-  { .pos = { +1.0f, +1.0f }, .texcoord = { 1.0f, 1.0f } },
-  { .pos = { +1.0f, -1.0f }, .texcoord = { 1.0f, 0.0f } },
-  { .pos = { -1.0f, -1.0f }, .texcoord = { 0.0f, 0.0f } },
-  { .pos = { -1.0f, +1.0f }, .texcoord = { 0.0f, 1.0f } },
+inline constexpr PackedTextureVertex kTextureQuadVertices[] = {
+  { .pos = pack_unit_position({ +1.0f, +1.0f }), .texcoord = { 65535, 65535 } },
+  { .pos = pack_unit_position({ +1.0f, -1.0f }), .texcoord = { 65535, 0 } },
+  { .pos = pack_unit_position({ -1.0f, -1.0f }), .texcoord = { 0, 0 } },
+  { .pos = pack_unit_position({ -1.0f, +1.0f }), .texcoord = { 0, 65535 } },
 };
 
 inline constexpr GLushort kQuadIndices[] = {
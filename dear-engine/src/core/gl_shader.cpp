@@ -1,13 +1,19 @@
 #include "gl_shader.hpp"
 
 #include <array>
+#include <vector>
+#include <chrono>
 #include <string>
+#include <fstream>
 #include <optional>
+#include <filesystem>
+#include <algorithm>
 
 #include <glbinding/gl33core/gl.h>
 using namespace gl;
 
 #include "log.hpp"
+#include "gl_state.hpp"
 #include "unique_num.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -16,20 +22,23 @@ using namespace gl;
 GLShader::GLShader(std::string name)
     : name_(std::move(name)), id_(glCreateProgram())
 {
+  // Each variant loads only its own locations, the others stay -1 so they never alias location 0
+  attrs_.fill(-1);
+  unifs_.fill(-1);
   TRACE("New GLShader program '{}'[{}]", name_, id_);
 }
 
 GLShader::~GLShader()
 {
   if (id_) {
-    glDeleteProgram(id_);
+    gl_release(GLKind::PROGRAM, id_);
     TRACE("Delete GLShader program '{}'[{}]", name_, id_);
   }
 }
 
-void GLShader::bind() { glUseProgram(id_); }
+void GLShader::bind() const { gl_state().use_program(id_); }
 
-void GLShader::unbind() { glUseProgram(0); }
+void GLShader::unbind() const { gl_state().use_program(0); }
 
 void GLShader::load_attr_loc(GLAttr attr, std::string_view attr_name)
 {
@@ -47,34 +56,274 @@ void GLShader::load_unif_loc(GLUnif unif, std::string_view unif_name)
   unifs_[static_cast<size_t>(unif)] = loc;
 }
 
-auto GLShader::build(std::string name, std::string_view vert_src, std::string_view frag_src) -> std::optional<GLShader>
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Program Binary Cache
+
+/// Program binary file header, followed by the binary
+struct ProgramBinaryHeader {
+  static constexpr uint32_t kMagic = 0x42504544; // "DEPB"
+  uint32_t magic;
+  uint32_t format; // driver's binary format
+  uint32_t size;   // binary size in bytes
+  float build_ms;  // time the loading thread spent building the program from sources
+};
+
+/// State of the program binary cache
+struct ProgramCache {
+  std::string dir;               // empty when disabled
+  std::optional<bool> supported; // probed on first use, needs a current context
+  std::string driver;            // vendor, renderer and version strings, binaries are only valid for the same driver
+  std::vector<GLint> formats;    // binary formats the driver accepts
+};
+
+static auto program_cache() -> ProgramCache&
+{
+  static ProgramCache cache;
+  return cache;
+}
+
+/// Enable the on-disk program binary cache in the directory
+void enable_shader_cache(std::string dir)
+{
+  INFO("Shader program binary cache enabled in '{}'", dir);
+  program_cache().dir = std::move(dir);
+}
+
+/// Check if the cache is enabled and the driver can save program binaries (GL 4.1 or ARB_get_program_binary)
+static bool program_cache_usable()
+{
+  ProgramCache& cache = program_cache();
+  if (cache.dir.empty()) return false;
+  if (!cache.supported) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    while (glGetError() != GL_NO_ERROR) {} // the query is an invalid enum without support
+    cache.supported = formats > 0;
+    if (formats > 0) {
+      cache.formats.resize(formats);
+      glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, cache.formats.data());
+    }
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+      const auto* str = (const char*)glGetString(name);
+      cache.driver.append(str ? str : "").push_back('\n');
+    }
+    if (!*cache.supported) WARN("Driver can't save shader program binaries, shader cache disabled");
+  }
+  return *cache.supported;
+}
+
+/// Path of a program's cache file, keyed by a hash of its sources and the driver
+static auto program_cache_path(std::string_view vert_src, std::string_view frag_src) -> std::string
+{
+  const ProgramCache& cache = program_cache();
+  uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+  for (std::string_view str : { std::string_view(cache.driver), vert_src, std::string_view("\0", 1), frag_src }) {
+    for (char ch : str) {
+      hash ^= (uint8_t)ch;
+      hash *= 0x100000001b3ull;
+    }
+  }
+  return (std::filesystem::path(cache.dir) / fmt::format("{:016x}.bin", hash)).string();
+}
+
+/// Load the program from a cached binary, returns false if missing or rejected by the driver
+bool GLShader::load_binary(const std::string& path, float& build_ms)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) return false;
+  const auto file_size = (size_t)file.tellg();
+  file.seekg(0);
+  ProgramBinaryHeader header;
+  if (!file.read((char*)&header, sizeof(header)) || header.magic != ProgramBinaryHeader::kMagic) {
+    WARN("Invalid program binary cache file '{}'", path);
+    return false;
+  }
+  // Never trust sizes read from disk, a corrupt file could ask for any allocation
+  if (header.size == 0 || header.size > file_size - sizeof(header)) {
+    WARN("Invalid program binary size {} in cache file '{}' of {} bytes", header.size, path, file_size);
+    return false;
+  }
+  const auto& formats = program_cache().formats;
+  if (std::find(formats.begin(), formats.end(), (GLint)header.format) == formats.end()) {
+    DEBUG("Program binary format {:#x} of cache file '{}' not supported by the driver", header.format, path);
+    return false;
+  }
+  auto binary = std::make_unique<char[]>(header.size);
+  if (!file.read(binary.get(), header.size)) {
+    WARN("Truncated program binary cache file '{}'", path);
+    return false;
+  }
+  glProgramBinary(id_, static_cast<GLenum>(header.format), binary.get(), header.size);
+  GLint link_status = 0;
+  glGetProgramiv(id_, GL_LINK_STATUS, &link_status);
+  if (!link_status) {
+    // E.g. the driver was updated without changing its version string
+    DEBUG("Program binary for GLShader '{}'[{}] rejected by the driver, building from sources", name_, id_);
+    return false;
+  }
+  build_ms = header.build_ms;
+  return true;
+}
+
+/// Save the linked program's binary to the cache
+void GLShader::save_binary(const std::string& path, float build_ms) const
 {
-  auto shader = GLShader(std::move(name));
-  auto vertex = shader.compile(GL_VERTEX_SHADER, vert_src.data());
-  auto fragment = shader.compile(GL_FRAGMENT_SHADER, frag_src.data());
-  if (!vertex || !fragment) {
+  GLint size = 0;
+  glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0) { WARN("No program binary for GLShader '{}'[{}]", name_, id_); return; }
+  auto binary = std::make_unique<char[]>(size);
+  GLenum format;
+  glGetProgramBinary(id_, size, nullptr, &format, binary.get());
+  const auto header = ProgramBinaryHeader{
+    .magic = ProgramBinaryHeader::kMagic, .format = static_cast<uint32_t>(format), .size = (uint32_t)size, .build_ms = build_ms,
+  };
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+  // Written aside and renamed, so a concurrent launch never reads a partial file
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.get(), size)) {
+      WARN("Failed to write program binary cache file '{}'", tmp_path);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) WARN("Failed to save program binary cache file '{}' ({})", path, ec.message());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Shader Build
+
+/// Check if the context supports an extension
+static bool has_gl_extension(std::string_view name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const auto* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && name == ext) return true;
+  }
+  return false;
+}
+
+/// Check if programs can be polled for completion (KHR_parallel_shader_compile), enabling compiler threads on first call
+static bool parallel_compile_supported()
+{
+  static std::optional<bool> supported;
+  if (!supported) {
+    supported = has_gl_extension("GL_KHR_parallel_shader_compile");
+    if (*supported) {
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver likes
+      DEBUG("Shaders compiled in parallel with KHR_parallel_shader_compile");
+    }
+  }
+  return *supported;
+}
+
+PendingGLShader::PendingGLShader(GLShader shader)
+    : shader_(std::move(shader)), begin_(std::chrono::steady_clock::now())
+{
+}
+
+PendingGLShader::~PendingGLShader()
+{
+  if (vert_) glDeleteShader(vert_);
+  if (frag_) glDeleteShader(frag_);
+}
+
+/// Milliseconds since submission
+auto PendingGLShader::elapsed_ms() const -> float
+{
+  return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin_).count();
+}
+
+bool PendingGLShader::ready() const
+{
+  if (!vert_ || !parallel_compile_supported()) return true;
+  GLint done = 0;
+  glGetProgramiv(shader_->id(), GL_COMPLETION_STATUS_KHR, &done);
+  return done;
+}
+
+auto PendingGLShader::finish() -> std::optional<GLShader>
+{
+  ASSERT_MSG(shader_, "PendingGLShader finished twice");
+  GLShader shader = std::move(*shader_);
+  shader_.reset();
+  if (!vert_) return shader; // loaded from the binary cache
+
+  // Status queries wait on the driver, all programs should have been submitted by now
+  const auto wait_begin = std::chrono::steady_clock::now();
+  const bool vert_ok = shader.check_compile(vert_, GL_VERTEX_SHADER);
+  const bool frag_ok = shader.check_compile(frag_, GL_FRAGMENT_SHADER);
+  const bool linked = shader.check_link();
+  build_ms_ += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - wait_begin).count();
+  glDetachShader(shader.id_, vert_);
+  glDetachShader(shader.id_, frag_);
+  glDeleteShader(vert_);
+  glDeleteShader(frag_);
+  vert_ = 0;
+  frag_ = 0;
+  if (!vert_ok || !frag_ok) {
     ERROR("Failed to Compile Shaders for program '{}'[{}]", shader.name_, shader.id_);
-    if (vertex) glDeleteShader(*vertex);
-    if (fragment) glDeleteShader(*fragment);
     return std::nullopt;
   }
-  if (!shader.link(*vertex, *fragment)) {
+  if (!linked) {
     ERROR("Failed to Link GLShader program '{}'[{}]", shader.name_, shader.id_);
-    glDeleteShader(*vertex);
-    glDeleteShader(*fragment);
     return std::nullopt;
   }
-  glDeleteShader(*vertex);
-  glDeleteShader(*fragment);
   TRACE("Compiled&Linked shader program '{}'[{}]", shader.name_, shader.id_);
+  if (!cache_path_.empty()) {
+    // Not the time since submission, which includes the other programs submitted meanwhile and their waits.
+    // Work the driver did on its own compiler threads isn't counted, so it's a lower bound with parallel compile.
+    shader.save_binary(cache_path_, build_ms_);
+    DEBUG("Built GLShader program '{}'[{}] from sources in {:.2f} ms, saved to binary cache", shader.name_, shader.id_, build_ms_);
+  }
   return shader;
 }
 
-auto GLShader::compile(GLenum shader_type, const char *shader_src) -> std::optional<GLuint>
+auto GLShader::submit(std::string name, std::string_view vert_src, std::string_view frag_src) -> PendingGLShader
+{
+  parallel_compile_supported();
+  auto pending = PendingGLShader(GLShader(std::move(name)));
+  GLShader& shader = *pending.shader_;
+  if (program_cache_usable()) {
+    std::string cache_path = program_cache_path(vert_src, frag_src);
+    float build_ms = 0.0f;
+    if (shader.load_binary(cache_path, build_ms)) {
+      const float load_ms = pending.elapsed_ms();
+      INFO("Loaded GLShader program '{}'[{}] from binary cache in {:.2f} ms, saved {:.2f} ms of compilation",
+           shader.name_, shader.id_, load_ms, build_ms - load_ms);
+      return pending;
+    }
+    glProgramParameteri(shader.id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, 1);
+    pending.cache_path_ = std::move(cache_path);
+  }
+  const auto build_begin = std::chrono::steady_clock::now();
+  pending.vert_ = shader.compile(GL_VERTEX_SHADER, vert_src.data());
+  pending.frag_ = shader.compile(GL_FRAGMENT_SHADER, frag_src.data());
+  shader.link(pending.vert_, pending.frag_);
+  // Drivers without compiler threads may do the whole build here
+  pending.build_ms_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - build_begin).count();
+  return pending;
+}
+
+auto GLShader::build(std::string name, std::string_view vert_src, std::string_view frag_src) -> std::optional<GLShader>
+{
+  return submit(std::move(name), vert_src, frag_src).finish();
+}
+
+auto GLShader::compile(GLenum shader_type, const char *shader_src) -> GLuint
 {
   GLuint shader = glCreateShader(shader_type);
   glShaderSource(shader, 1, &shader_src, nullptr);
   glCompileShader(shader);
+  return shader;
+}
+
+bool GLShader::check_compile(GLuint shader, GLenum shader_type)
+{
   GLint info_len = 0;
   glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_len);
   if (info_len) {
@@ -84,18 +333,18 @@ auto GLShader::compile(GLenum shader_type, const char *shader_src) -> std::optio
   }
   GLint compiled = 0;
   glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-  if (!compiled) {
+  if (!compiled)
     ERROR("Failed to Compile {} for GLShader '{}'[{}]", shader_type_str(shader_type), name_, id_);
-    glDeleteShader(shader);
-    return std::nullopt;
-  }
-  return shader;
+  return compiled;
 }
 
-bool GLShader::link(GLuint vert, GLuint frag) {
+void GLShader::link(GLuint vert, GLuint frag) {
   glAttachShader(id_, vert);
   glAttachShader(id_, frag);
   glLinkProgram(id_);
+}
+
+bool GLShader::check_link() {
   GLint info_len = 0;
   glGetProgramiv(id_, GL_INFO_LOG_LENGTH, &info_len);
   if (info_len) {
@@ -107,8 +356,6 @@ bool GLShader::link(GLuint vert, GLuint frag) {
   glGetProgramiv(id_, GL_LINK_STATUS, &link_status);
   if (!link_status)
     ERROR("Failed to Link GLShader Program '{}'[{}]", name_, id_);
-  glDetachShader(id_, vert);
-  glDetachShader(id_, frag);
   return link_status;
 }
 
@@ -122,3 +369,67 @@ auto GLShader::shader_type_str(GLenum shader_type) -> std::string_view {
   }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Shader Variants
+
+/// Insert a macro definition into shader source, after its #version directive, which must come first
+static auto define_macro(std::string_view src, std::string_view macro) -> std::string
+{
+  size_t pos = 0;
+  if (const size_t version = src.find("#version"); version != std::string_view::npos) {
+    pos = src.find('\n', version);
+    pos = pos == std::string_view::npos ? src.size() : pos + 1;
+  }
+  std::string out;
+  out.reserve(src.size() + macro.size() + 16);
+  out.append(src.substr(0, pos));
+  out.append("#define ").append(macro).append(" 1\n");
+  out.append(src.substr(pos));
+  return out;
+}
+
+auto GLShaderVariants::sub_macro(GLSub sub) -> std::string_view
+{
+  switch (sub) {
+  case GLSub::TEXTURE: return "GLSUB_TEXTURE";
+  case GLSub::FONT: return "GLSUB_FONT";
+  case GLSub::COLOR: return "GLSUB_COLOR";
+  default:
+    ABORT_MSG("Invalid shader subroutine {}", (int)sub);
+    return "<invalid>";
+  }
+}
+
+auto GLShaderVariants::submit(const std::string& name, std::string_view vert_src, std::string_view frag_src) -> std::vector<PendingGLShader>
+{
+  std::vector<PendingGLShader> variants;
+  variants.reserve(static_cast<size_t>(GLSub::COUNT));
+  for (size_t i = 0; i < static_cast<size_t>(GLSub::COUNT); i++) {
+    const std::string_view macro = sub_macro(static_cast<GLSub>(i));
+    variants.emplace_back(GLShader::submit(fmt::format("{}:{}", name, macro),
+                                           define_macro(vert_src, macro), define_macro(frag_src, macro)));
+  }
+  return variants;
+}
+
+bool GLShaderVariants::ready(const std::vector<PendingGLShader>& pending)
+{
+  return std::all_of(pending.begin(), pending.end(), [](const PendingGLShader& variant) { return variant.ready(); });
+}
+
+auto GLShaderVariants::finish(std::vector<PendingGLShader> pending) -> std::optional<GLShaderVariants>
+{
+  std::vector<GLShader> variants;
+  variants.reserve(pending.size());
+  for (PendingGLShader& variant : pending) {
+    auto shader = variant.finish();
+    if (!shader) return std::nullopt;
+    variants.emplace_back(std::move(*shader));
+  }
+  return GLShaderVariants(std::move(variants));
+}
+
+auto GLShaderVariants::build(const std::string& name, std::string_view vert_src, std::string_view frag_src) -> std::optional<GLShaderVariants>
+{
+  return finish(submit(name, vert_src, frag_src));
+}
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <string>
+#include <vector>
 #include <optional>
+#include <string_view>
 
 #include <glbinding/gl33core/types.h>
 using namespace gl;
@@ -18,6 +21,9 @@ enum class GLAttr {
   COLOR,
   MODEL,
   TEXCOORD,
+  TEXRECT,
+  OUTLINE_COLOR,
+  OUTLINE_THICKNESS,
   COUNT, // must be last
 };
 
@@ -30,19 +36,28 @@ enum class GLUnif {
   VIEW,
   PROJECTION,
   TEXTURE0,
-  SUBROUTINE,
+  SDF_SPREAD,
+  DEPTH,
+  ALPHA_CUTOFF,
   COUNT, // must be last
 };
 
-/// Enumeration of supported Shader Subroutines
+/// Enumeration of supported Shader Subroutines, each compiled as its own variant of a GLShaderVariants
 enum class GLSub {
   TEXTURE,
   FONT,
   COLOR,
+  COUNT, // must be last
 };
 
+/// Enable the on-disk program binary cache in the directory. From then on GLShader::build loads programs from it,
+/// keyed by a hash of their sources and the driver's vendor, renderer and version, and saves the ones it builds.
+/// Binaries the driver rejects are rebuilt from sources transparently. Needs GL 4.1 or ARB_get_program_binary.
+void enable_shader_cache(std::string dir);
+
 /// GLShader represents an OpenGL shader program
 class GLShader final {
+  friend class PendingGLShader;
 
   explicit GLShader(std::string name);
 
@@ -58,19 +73,26 @@ class GLShader final {
   /// Get shader program name
   [[nodiscard]] std::string_view name() const { return name_; }
 
-  /// Build a shader program from sources
+  /// Get shader program ID
+  [[nodiscard]] GLuint id() const { return id_; }
+
+  /// Build a shader program from sources, waiting for the driver to finish it
   static auto build(std::string name, std::string_view vert_src, std::string_view frag_src) -> std::optional<GLShader>;
 
+  /// Submit a shader program build from sources without waiting for the driver, finish it with PendingGLShader::finish().
+  /// Submit all programs before finishing any, so drivers with compiler threads build them concurrently.
+  static auto submit(std::string name, std::string_view vert_src, std::string_view frag_src) -> class PendingGLShader;
+
   /// Bind shader program
-  void bind();
+  void bind() const;
 
   /// Unbind shader program
-  void unbind();
+  void unbind() const;
 
-  /// Get attribute location
+  /// Get attribute location, -1 when not loaded
   [[nodiscard]] GLint attr_loc(GLAttr attr) const { return attrs_[static_cast<size_t>(attr)]; }
 
-  /// Get uniform location
+  /// Get uniform location, -1 when not loaded
   [[nodiscard]] GLint unif_loc(GLUnif unif) const { return unifs_[static_cast<size_t>(unif)]; }
 
   /// Load attributes' location into local array
@@ -80,11 +102,24 @@ class GLShader final {
   void load_unif_loc(GLUnif unif, std::string_view unif_name);
 
  private:
-  /// Compile a single shader from sources
-  auto compile(GLenum shader_type, const char* shader_src) -> std::optional<GLuint>;
+  /// Submit a single shader compilation from sources
+  auto compile(GLenum shader_type, const char* shader_src) -> GLuint;
+
+  /// Check a shader's compilation status and log its output, waits for the compilation to finish
+  bool check_compile(GLuint shader, GLenum shader_type);
+
+  /// Submit the link of shaders into program object
+  void link(GLuint vert, GLuint frag);
+
+  /// Check the program's link status and log its output, waits for the link to finish
+  bool check_link();
 
-  /// Link shaders into program object
-  bool link(GLuint vert, GLuint frag);
+  /// Load the program from a cached binary, returns false if missing or rejected by the driver.
+  /// Sets build_ms to the time it took to build from sources when cached.
+  bool load_binary(const std::string& path, float& build_ms);
+
+  /// Save the linked program's binary to the cache, with the time it took to build from sources
+  void save_binary(const std::string& path, float build_ms) const;
 
   /// Stringify opengl shader type.
   static auto shader_type_str(GLenum shader_type) -> std::string_view;
@@ -100,3 +135,74 @@ class GLShader final {
   std::array<GLint, static_cast<size_t>(GLUnif::COUNT)> unifs_ = { -1 };
 };
 
+/// PendingGLShader is a shader program submitted to the driver, compiling and linking in the background
+/// when the driver supports KHR_parallel_shader_compile, or at its own pace until its status is queried otherwise.
+class PendingGLShader final {
+  friend class GLShader;
+
+  explicit PendingGLShader(GLShader shader);
+
+ public:
+  ~PendingGLShader();
+
+  // Movable but not Copyable
+  PendingGLShader(PendingGLShader&&) = default;
+  PendingGLShader(const PendingGLShader&) = delete;
+  PendingGLShader& operator=(PendingGLShader&&) = default;
+  PendingGLShader& operator=(const PendingGLShader&) = delete;
+
+  /// Check if the build is done, so finish() won't wait. Always true without KHR_parallel_shader_compile.
+  [[nodiscard]] bool ready() const;
+
+  /// Wait for the build and check its status, returns the shader program if it succeeded
+  auto finish() -> std::optional<GLShader>;
+
+ private:
+  /// Milliseconds since submission
+  [[nodiscard]] auto elapsed_ms() const -> float;
+
+ private:
+  std::optional<GLShader> shader_;
+  UniqueNum<GLuint> vert_;  // zero when loaded from the binary cache
+  UniqueNum<GLuint> frag_;
+  std::string cache_path_;  // binary cache file to save to, empty if not cached
+  std::chrono::steady_clock::time_point begin_;
+  float build_ms_ = 0.0f;   // time this thread spent issuing the build and waiting on its status
+};
+
+/// GLShaderVariants holds one program per GLSub specialized from a single source by #define permutations.
+/// Each variant is compiled with its GLSub's macro defined (GLSUB_TEXTURE, GLSUB_FONT, GLSUB_COLOR), so the shader
+/// selects its path with #ifdef instead of branching on a uniform, and has its own attribute and uniform locations.
+/// Vertex attributes should have explicit locations, so VAOs built for one variant work with all of them.
+class GLShaderVariants final {
+  explicit GLShaderVariants(std::vector<GLShader> variants) : variants_(std::move(variants)) {}
+
+ public:
+  // Movable but not Copyable
+  GLShaderVariants(GLShaderVariants&&) = default;
+  GLShaderVariants(const GLShaderVariants&) = delete;
+  GLShaderVariants& operator=(GLShaderVariants&&) = default;
+  GLShaderVariants& operator=(const GLShaderVariants&) = delete;
+
+  /// Build a shader program for each GLSub from the same sources
+  static auto build(const std::string& name, std::string_view vert_src, std::string_view frag_src) -> std::optional<GLShaderVariants>;
+
+  /// Submit the build of a shader program for each GLSub from the same sources, by GLSub
+  static auto submit(const std::string& name, std::string_view vert_src, std::string_view frag_src) -> std::vector<PendingGLShader>;
+
+  /// Check if all submitted variants builds are done, so finish() won't wait
+  [[nodiscard]] static bool ready(const std::vector<PendingGLShader>& pending);
+
+  /// Finish submitted variants builds, fails if any variant fails
+  static auto finish(std::vector<PendingGLShader> pending) -> std::optional<GLShaderVariants>;
+
+  /// Get the variant of a subroutine
+  [[nodiscard]] GLShader& get(GLSub sub) { return variants_[static_cast<size_t>(sub)]; }
+  [[nodiscard]] const GLShader& get(GLSub sub) const { return variants_[static_cast<size_t>(sub)]; }
+
+  /// Get the name of the macro defined in the variant of a subroutine
+  static auto sub_macro(GLSub sub) -> std::string_view;
+
+ private:
+  std::vector<GLShader> variants_; // by GLSub
+};
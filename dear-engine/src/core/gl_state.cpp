@@ -0,0 +1,325 @@
+#include "gl_state.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <glm/gtc/type_ptr.hpp>
+
+#include "log.hpp"
+#include "renderer.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// GL State
+
+void GLState::use_program(GLuint program)
+{
+  count(program_ != program);
+  if (program_ == program) return;
+  glUseProgram(program);
+  program_ = program;
+  program_uniforms_ = program ? &uniforms_[program] : nullptr;
+}
+
+void GLState::bind_vertex_array(GLuint vao)
+{
+  count(vao_ != vao);
+  if (vao_ == vao) return;
+  glBindVertexArray(vao);
+  vao_ = vao;
+  render_stats().vao_binds++;
+}
+
+void GLState::bind_texture(GLuint unit, GLuint texture)
+{
+  const bool shadowed = unit < kTextureUnits;
+  count(!shadowed || textures_[unit] != texture);
+  if (shadowed && textures_[unit] == texture) return;
+  if (active_unit_ != unit) {
+    glActiveTexture(static_cast<GLenum>(static_cast<unsigned int>(GL_TEXTURE0) + unit));
+    active_unit_ = unit;
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  if (shadowed) textures_[unit] = texture;
+  render_stats().texture_binds++;
+}
+
+void GLState::bind_framebuffer(GLenum target, GLuint fbo)
+{
+  const bool draw = target != GL_READ_FRAMEBUFFER;
+  const bool read = target != GL_DRAW_FRAMEBUFFER;
+  const bool changed = (draw && draw_framebuffer_ != fbo) || (read && read_framebuffer_ != fbo);
+  count(changed);
+  if (!changed) return;
+  glBindFramebuffer(target, fbo);
+  if (draw) draw_framebuffer_ = fbo;
+  if (read) read_framebuffer_ = fbo;
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  const auto rect = std::array<GLint, 4>{ x, y, width, height };
+  count(viewport_ != rect);
+  if (viewport_ == rect) return;
+  glViewport(x, y, width, height);
+  viewport_ = rect;
+}
+
+void GLState::enable_blend(GLenum sfactor_rgb, GLenum dfactor_rgb, GLenum sfactor_alpha, GLenum dfactor_alpha)
+{
+  count(blend_ != true);
+  if (blend_ != true) {
+    glEnable(GL_BLEND);
+    blend_ = true;
+  }
+  const auto func = std::array{ sfactor_rgb, dfactor_rgb, sfactor_alpha, dfactor_alpha };
+  count(blend_func_ != func);
+  if (blend_func_ != func) {
+    glBlendFuncSeparate(sfactor_rgb, dfactor_rgb, sfactor_alpha, dfactor_alpha);
+    blend_func_ = func;
+  }
+}
+
+void GLState::disable_blend()
+{
+  count(blend_ != false);
+  if (blend_ == false) return;
+  glDisable(GL_BLEND);
+  blend_ = false;
+}
+
+void GLState::enable_depth_test(GLenum func)
+{
+  count(depth_test_ != true);
+  if (depth_test_ != true) {
+    glEnable(GL_DEPTH_TEST);
+    depth_test_ = true;
+  }
+  count(depth_func_ != func);
+  if (depth_func_ != func) {
+    glDepthFunc(func);
+    depth_func_ = func;
+  }
+}
+
+void GLState::disable_depth_test()
+{
+  count(depth_test_ != false);
+  if (depth_test_ == false) return;
+  glDisable(GL_DEPTH_TEST);
+  depth_test_ = false;
+}
+
+void GLState::depth_mask(bool write)
+{
+  count(depth_mask_ != write);
+  if (depth_mask_ == write) return;
+  glDepthMask(write ? GL_TRUE : GL_FALSE);
+  depth_mask_ = write;
+}
+
+void GLState::enable_scissor_test(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  count(scissor_test_ != true);
+  if (scissor_test_ != true) {
+    glEnable(GL_SCISSOR_TEST);
+    scissor_test_ = true;
+  }
+  const auto rect = std::array<GLint, 4>{ x, y, width, height };
+  count(scissor_box_ != rect);
+  if (scissor_box_ != rect) {
+    glScissor(x, y, width, height);
+    scissor_box_ = rect;
+  }
+}
+
+void GLState::disable_scissor_test()
+{
+  count(scissor_test_ != false);
+  if (scissor_test_ == false) return;
+  glDisable(GL_SCISSOR_TEST);
+  scissor_test_ = false;
+}
+
+void GLState::polygon_mode(GLenum mode)
+{
+  count(polygon_mode_ != mode);
+  if (polygon_mode_ == mode) return;
+  glPolygonMode(GL_FRONT_AND_BACK, mode);
+  polygon_mode_ = mode;
+}
+
+void GLState::uniform(GLint loc, GLint value)
+{
+  if (uniform_changed(loc, &value, sizeof(value))) glUniform1i(loc, value);
+}
+
+void GLState::uniform(GLint loc, GLfloat value)
+{
+  if (uniform_changed(loc, &value, sizeof(value))) glUniform1f(loc, value);
+}
+
+void GLState::uniform(GLint loc, const glm::vec4& value)
+{
+  if (uniform_changed(loc, glm::value_ptr(value), sizeof(value))) glUniform4fv(loc, 1, glm::value_ptr(value));
+}
+
+void GLState::uniform(GLint loc, const glm::mat4& value)
+{
+  if (uniform_changed(loc, glm::value_ptr(value), sizeof(value))) glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+bool GLState::uniform_changed(GLint loc, const void* value, size_t size)
+{
+  if (loc < 0) return false; // inactive uniform, GL ignores it anyway
+  if (!program_uniforms_) { count(true); return true; }
+  auto& values = *program_uniforms_;
+  if (values.size() <= (size_t)loc) values.resize(loc + 1);
+  UniformValue& shadow = values[loc];
+  const uint8_t words = size / sizeof(uint32_t);
+  const bool changed = shadow.size != words || std::memcmp(shadow.words.data(), value, size) != 0;
+  if (changed) {
+    shadow.size = words;
+    std::memcpy(shadow.words.data(), value, size);
+  }
+  count(changed);
+  return changed;
+}
+
+void GLState::forget_program(GLuint program)
+{
+  // A program deleted while in use stays in use, its name just can't be reused until then
+  if (program_ == program) {
+    program_.reset();
+    program_uniforms_ = nullptr;
+  }
+  uniforms_.erase(program);
+}
+
+void GLState::forget_vertex_array(GLuint vao)
+{
+  if (vao_ == vao) vao_ = 0;
+}
+
+void GLState::forget_texture(GLuint texture)
+{
+  for (auto& bound : textures_)
+    if (bound == texture) bound = 0;
+}
+
+void GLState::forget_framebuffer(GLuint fbo)
+{
+  // Deleting a bound framebuffer binds the default one in its place
+  if (draw_framebuffer_ == fbo) draw_framebuffer_ = 0;
+  if (read_framebuffer_ == fbo) read_framebuffer_ = 0;
+}
+
+void GLState::invalidate()
+{
+  // Uniform values are program state, they survive any context state change made by others
+  program_.reset();
+  program_uniforms_ = nullptr;
+  vao_.reset();
+  active_unit_.reset();
+  std::fill(textures_.begin(), textures_.end(), std::nullopt);
+  draw_framebuffer_.reset();
+  read_framebuffer_.reset();
+  viewport_.reset();
+  blend_.reset();
+  blend_func_.reset();
+  depth_test_.reset();
+  depth_func_.reset();
+  depth_mask_.reset();
+  scissor_test_.reset();
+  scissor_box_.reset();
+  polygon_mode_.reset();
+}
+
+void GLState::count(bool issued)
+{
+  auto& stats = render_stats();
+  if (issued) stats.gl_calls_issued++;
+  else stats.gl_calls_skipped++;
+}
+
+/// Get the GL state tracker of the main context
+auto gl_state() -> GLState&
+{
+  static GLState state;
+  return state;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// GL Release
+
+/// Owner thread of the GL context and the deletions queued by other threads
+struct GLReleaseQueue {
+  std::atomic<std::thread::id> owner;
+  std::mutex mutex;
+  std::vector<std::pair<GLKind, GLuint>> pending;
+};
+
+static auto gl_release_queue() -> GLReleaseQueue&
+{
+  static GLReleaseQueue queue;
+  return queue;
+}
+
+/// Delete a GL object now, on the owner thread
+static void delete_gl_object(GLKind kind, GLuint name)
+{
+  switch (kind) {
+    case GLKind::BUFFER: glDeleteBuffers(1, &name); break;
+    case GLKind::VERTEX_ARRAY: gl_state().forget_vertex_array(name); glDeleteVertexArrays(1, &name); break;
+    case GLKind::TEXTURE: gl_state().forget_texture(name); glDeleteTextures(1, &name); break;
+    case GLKind::FRAMEBUFFER: gl_state().forget_framebuffer(name); glDeleteFramebuffers(1, &name); break;
+    case GLKind::RENDERBUFFER: glDeleteRenderbuffers(1, &name); break;
+    case GLKind::PROGRAM: gl_state().forget_program(name); glDeleteProgram(name); break;
+  }
+}
+
+/// Make the calling thread the owner of the GL context
+void set_gl_owner_thread()
+{
+  gl_release_queue().owner = std::this_thread::get_id();
+}
+
+/// Leave the GL context without owner while it's handed over
+void clear_gl_owner_thread()
+{
+  gl_release_queue().owner = std::thread::id();
+}
+
+/// Delete a GL object right away on the GL context's owner thread, or queue it
+void gl_release(GLKind kind, GLuint name)
+{
+  if (!name) return;
+  GLReleaseQueue& queue = gl_release_queue();
+  if (queue.owner.load() == std::this_thread::get_id()) {
+    delete_gl_object(kind, name);
+    return;
+  }
+  std::lock_guard lock(queue.mutex);
+  queue.pending.emplace_back(kind, name);
+}
+
+/// Delete the GL objects released by other threads
+void flush_gl_releases()
+{
+  GLReleaseQueue& queue = gl_release_queue();
+  ASSERT(queue.owner.load() == std::this_thread::get_id());
+  std::vector<std::pair<GLKind, GLuint>> pending;
+  {
+    std::lock_guard lock(queue.mutex);
+    if (queue.pending.empty()) return;
+    pending.swap(queue.pending);
+  }
+  for (auto [kind, name] : pending)
+    delete_gl_object(kind, name);
+}
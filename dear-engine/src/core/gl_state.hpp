@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <unordered_map>
+
+#include <glbinding/gl33core/types.h>
+using namespace gl;
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// GL State
+
+/// GLState shadows the GL context state the renderer touches (bound program, VAO, texture units, framebuffers,
+/// viewport, blending, depth and scissor testing, polygon mode and uniform values per program) and skips calls that would set what is already set.
+/// Every change of that state must go through it, or the shadow goes stale; code that changes it behind
+/// its back (e.g. a third party renderer not restoring state) must call invalidate() afterwards.
+/// Issued and skipped calls are counted in the frame's RenderStats.
+/// It is not synchronized: only the thread owning the GL context may use it, see set_gl_owner_thread().
+class GLState final {
+ public:
+  /// Texture units shadowed, binds to higher units are always issued
+  static constexpr size_t kTextureUnits = 8;
+
+  GLState() = default;
+
+  // Not Copyable or Movable, it mirrors the one GL context
+  GLState(const GLState&) = delete;
+  GLState& operator=(const GLState&) = delete;
+
+  /// glUseProgram
+  void use_program(GLuint program);
+
+  /// glBindVertexArray
+  void bind_vertex_array(GLuint vao);
+
+  /// glActiveTexture + glBindTexture(GL_TEXTURE_2D)
+  void bind_texture(GLuint unit, GLuint texture);
+
+  /// glBindFramebuffer, GL_FRAMEBUFFER binds both the draw and read framebuffers
+  void bind_framebuffer(GLenum target, GLuint fbo);
+
+  /// glViewport
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  /// glEnable(GL_BLEND) + glBlendFunc
+  void enable_blend(GLenum sfactor, GLenum dfactor) { enable_blend(sfactor, dfactor, sfactor, dfactor); }
+
+  /// glEnable(GL_BLEND) + glBlendFuncSeparate
+  void enable_blend(GLenum sfactor_rgb, GLenum dfactor_rgb, GLenum sfactor_alpha, GLenum dfactor_alpha);
+
+  /// glDisable(GL_BLEND)
+  void disable_blend();
+
+  /// glEnable(GL_DEPTH_TEST) + glDepthFunc
+  void enable_depth_test(GLenum func);
+
+  /// glDisable(GL_DEPTH_TEST)
+  void disable_depth_test();
+
+  /// glDepthMask
+  void depth_mask(bool write);
+
+  /// glEnable(GL_SCISSOR_TEST) + glScissor
+  void enable_scissor_test(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  /// glDisable(GL_SCISSOR_TEST)
+  void disable_scissor_test();
+
+  /// glPolygonMode(GL_FRONT_AND_BACK)
+  void polygon_mode(GLenum mode);
+
+  /// glUniform* on the program in use
+  void uniform(GLint loc, GLint value);
+  void uniform(GLint loc, GLfloat value);
+  void uniform(GLint loc, const glm::vec4& value);
+  void uniform(GLint loc, const glm::mat4& value);
+
+  /// Drop shadowed state of deleted objects, as GL unbinds them and their names may be reused
+  void forget_program(GLuint program);
+  void forget_vertex_array(GLuint vao);
+  void forget_texture(GLuint texture);
+  void forget_framebuffer(GLuint fbo);
+
+  /// Forget all shadowed state, so the next call of each kind is issued
+  void invalidate();
+
+ private:
+  /// Shadowed value of a uniform location, compared bitwise
+  struct UniformValue {
+    uint8_t size = 0; // number of 32-bit words set, zero when unknown
+    std::array<uint32_t, 16> words;
+  };
+
+  /// Check value against the shadow of the uniform location in the current program and update it,
+  /// returns true when the GL call must be issued
+  bool uniform_changed(GLint loc, const void* value, size_t size);
+
+  /// Count an issued or skipped call in the frame's RenderStats
+  static void count(bool issued);
+
+ private:
+  std::optional<GLuint> program_;
+  std::optional<GLuint> vao_;
+  std::optional<GLuint> active_unit_;
+  std::array<std::optional<GLuint>, kTextureUnits> textures_;
+  std::optional<GLuint> draw_framebuffer_;
+  std::optional<GLuint> read_framebuffer_;
+  std::optional<std::array<GLint, 4>> viewport_;
+  std::optional<bool> blend_;
+  std::optional<std::array<GLenum, 4>> blend_func_;
+  std::optional<bool> depth_test_;
+  std::optional<GLenum> depth_func_;
+  std::optional<bool> depth_mask_;
+  std::optional<bool> scissor_test_;
+  std::optional<std::array<GLint, 4>> scissor_box_;
+  std::optional<GLenum> polygon_mode_;
+  std::unordered_map<GLuint, std::vector<UniformValue>> uniforms_;
+  std::vector<UniformValue>* program_uniforms_ = nullptr; // uniforms_ entry of the current program
+};
+
+/// Get the GL state tracker of the main context
+auto gl_state() -> GLState&;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// GL Release
+
+/// Kinds of GL objects deleted through gl_release()
+enum class GLKind : uint8_t {
+  BUFFER,
+  VERTEX_ARRAY,
+  TEXTURE,
+  FRAMEBUFFER,
+  RENDERBUFFER,
+  PROGRAM,
+};
+
+/// Make the calling thread the owner of the GL context, the one that deletes GL objects.
+/// Call it whenever the context is made current on another thread.
+void set_gl_owner_thread();
+
+/// Leave the GL context without owner while it's handed over, deletions are queued until the next owner is set
+void clear_gl_owner_thread();
+
+/// Delete a GL object, dropping its shadowed state, right away when called on the GL context's owner thread.
+/// Called on any other thread (e.g. the last reference to a GLObject dropped by the game thread), the deletion
+/// is queued until the owner's next flush_gl_releases().
+void gl_release(GLKind kind, GLuint name);
+
+/// Delete the GL objects released by other threads, must be called on the GL context's owner thread
+void flush_gl_releases();
@@ -11,11 +11,25 @@ using namespace gl;
 
 #include "log.hpp"
 #include "file.hpp"
+#include "gl_state.hpp"
 #include "unique_num.hpp"
 
 using namespace std::string_literals;
 
-/// Read file and upload RGB/RBGA texture to GPU memory
+/// Classify RGBA pixels by their alpha
+auto classify_alpha(const uint8_t rgba[], size_t num_pixels) -> BlendMode
+{
+  BlendMode blend = BlendMode::NONE;
+  for (size_t i = 0; i < num_pixels; i++) {
+    const uint8_t alpha = rgba[i * 4 + 3];
+    if (alpha == 0xFF) continue;
+    if (alpha != 0) return BlendMode::ALPHA_BLEND;
+    blend = BlendMode::ALPHA_TEST;
+  }
+  return blend;
+}
+
+/// Read file and upload RGB/RBGA texture to GPU memory, classifying its alpha
 auto load_rgba_texture(const std::string& inpath, GLenum min_filter, GLenum mag_filter) -> std::optional<GLTexture>
 {
   const std::string filepath = ENGINE_ASSETS_PATH + "/"s + inpath;
@@ -29,15 +43,16 @@ auto load_rgba_texture(const std::string& inpath, GLenum min_filter, GLenum mag_
   GLenum type = (channels == 4) ? GL_RGBA : GL_RGB;
   GLuint texture;
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  gl_state().bind_texture(0, texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter != GLenum(0) ? mag_filter : min_filter);
   glTexImage2D(GL_TEXTURE_2D, 0, type, width, height, 0, type, GL_UNSIGNED_BYTE, data);
   glGenerateMipmap(GL_TEXTURE_2D);
+  const BlendMode blend = (channels == 4) ? classify_alpha(data, (size_t)width * height) : BlendMode::NONE;
   stbi_image_free(data);
-  return GLTexture{ texture };
+  return GLTexture{ .id = texture, .blend = blend };
 }
 
 /// Upload font bitmap texture to GPU memory
@@ -45,7 +60,7 @@ auto load_font_texture(const uint8_t data[], size_t width, size_t height) -> GLT
 {
   GLuint texture;
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture); 
+  gl_state().bind_texture(0, texture); 
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
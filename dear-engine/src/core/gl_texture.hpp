@@ -1,23 +1,37 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 #include <string>
 #include <optional>
 
 #include <glbinding/gl33core/gl.h>
 using namespace gl;
+#include <glm/vec4.hpp>
 
+#include "gl_state.hpp"
 #include "unique_num.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Texture
 
+/// How the fragments of a draw combine with what is already drawn, per its texture's alpha
+enum class BlendMode : uint8_t {
+  NONE,        // opaque, covers what is behind it
+  ALPHA_TEST,  // opaque where alpha is at least kAlphaCutoff, fully transparent elsewhere
+  ALPHA_BLEND, // partially transparent, blended over what is behind it
+};
+
+/// Alpha below which ALPHA_TEST fragments are discarded
+inline constexpr float kAlphaCutoff = 0.5f;
+
 /// Represents a texture loaded to GPU memory
 struct GLTexture {
   UniqueNum<GLuint> id;
+  BlendMode blend = BlendMode::ALPHA_BLEND; // how draws sampling all of it must be blended
 
   ~GLTexture() {
-    if (id) glDeleteTextures(1, &id.inner);
+    gl_release(GLKind::TEXTURE, id);
   }
 
   // Movable but not Copyable
@@ -30,7 +44,29 @@ struct GLTexture {
 /// GLTexture reference type alias
 using GLTextureRef = std::shared_ptr<GLTexture>;
 
-/// Read file and upload RGB/RBGA texture to GPU memory
+/// Texture coordinates rect (s0, t0, s1, t1) covering the whole texture
+inline constexpr glm::vec4 kFullTexRect = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+/// Area of a texture holding one image, either a whole texture or a sub-rect of an atlas page
+struct TextureRegion {
+  GLTextureRef texture;
+  glm::vec4 texrect = kFullTexRect; // texture coordinates rect (s0, t0, s1, t1) of the image in the texture
+  BlendMode blend = BlendMode::ALPHA_BLEND; // how draws of the image must be blended
+
+  /// Transform a texture coordinates rect local to the image (e.g. a spritesheet frame) to the texture's coordinates
+  [[nodiscard]] glm::vec4 map(const glm::vec4& rect) const {
+    const float width = texrect[2] - texrect[0];
+    const float height = texrect[3] - texrect[1];
+    return { texrect[0] + rect[0] * width, texrect[1] + rect[1] * height,
+             texrect[0] + rect[2] * width, texrect[1] + rect[3] * height };
+  }
+};
+
+/// Classify RGBA pixels by their alpha: NONE when all opaque, ALPHA_TEST when each is either opaque or fully
+/// transparent, ALPHA_BLEND otherwise
+auto classify_alpha(const uint8_t rgba[], size_t num_pixels) -> BlendMode;
+
+/// Read file and upload RGB/RBGA texture to GPU memory, classifying its alpha
 auto load_rgba_texture(const std::string& inpath, GLenum min_filter, GLenum mag_filter = GLenum(0)) -> std::optional<GLTexture>;
 
 /// Upload font bitmap texture to GPU memory
@@ -0,0 +1,179 @@
+#include "glyph_cache.hpp"
+
+#include <vector>
+#include <cstring>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <stb/stb_truetype.h>
+
+#include "log.hpp"
+#include "gl_state.hpp"
+#include "renderer.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Glyph Cache
+
+/// Texels left empty around each glyph, uploaded along with it, so linear filtering never reads a neighbour
+/// glyph or stale texels of an evicted one
+static constexpr int kGlyphGap = 1;
+
+/// Rasterized glyph pixels before upload
+struct GlyphBitmap {
+  int width = 0;
+  int height = 0;
+  glm::vec4 quad = glm::vec4(0.0f);
+  std::vector<uint8_t> pixels;
+};
+
+/// Rasterize a glyph of the font as coverage bitmap or signed distance field, per the font's kind
+static auto rasterize_glyph(const GLFont& font, int glyph) -> GlyphBitmap
+{
+  GlyphBitmap bitmap;
+  if (font.sdf_spread > 0.0f) {
+    constexpr unsigned char kOnEdge = 128;
+    int xoff = 0, yoff = 0;
+    uint8_t* sdf = stbtt_GetGlyphSDF(&font.info, font.scale, glyph, (int)font.sdf_spread, kOnEdge, kOnEdge / font.sdf_spread,
+                                     &bitmap.width, &bitmap.height, &xoff, &yoff);
+    if (!sdf) return GlyphBitmap{};
+    bitmap.pixels.assign(sdf, sdf + bitmap.width * bitmap.height);
+    stbtt_FreeSDF(sdf, nullptr);
+    bitmap.quad = glm::vec4(xoff, yoff, xoff + bitmap.width, yoff + bitmap.height);
+  } else {
+    const float scale = font.scale * font.oversampling;
+    int x0, y0, x1, y1;
+    stbtt_GetGlyphBitmapBox(&font.info, glyph, scale, scale, &x0, &y0, &x1, &y1);
+    bitmap.width = x1 - x0;
+    bitmap.height = y1 - y0;
+    if (bitmap.width <= 0 || bitmap.height <= 0) return GlyphBitmap{};
+    bitmap.pixels.resize(bitmap.width * bitmap.height);
+    stbtt_MakeGlyphBitmap(&font.info, bitmap.pixels.data(), bitmap.width, bitmap.height, bitmap.width, scale, scale, glyph);
+    bitmap.quad = glm::vec4(x0, y0, x1, y1) / (float)font.oversampling;
+  }
+  return bitmap;
+}
+
+/// Get a glyph of the font by glyph index, rasterizing and uploading it on first use
+auto GlyphCache::get(const GLFont& font, int glyph) -> const CachedGlyph*
+{
+  const uint64_t key = (uint64_t)font.id << 32 | (uint32_t)glyph;
+  if (auto it = glyphs_.find(key); it != glyphs_.end()) {
+    if (it->second.page) it->second.page->last_used = frame_;
+    return &it->second.glyph;
+  }
+
+  GlyphBitmap bitmap = rasterize_glyph(font, glyph);
+  if (bitmap.pixels.empty()) { // blank glyph, only advances the pen
+    return &glyphs_.emplace(key, Entry{ .glyph = CachedGlyph{ .page = nullptr, .texrect = {}, .quad = bitmap.quad }, .page = nullptr })
+                .first->second.glyph;
+  }
+  const int slot_w = bitmap.width + 2 * kGlyphGap;
+  const int slot_h = bitmap.height + 2 * kGlyphGap;
+  if (slot_w > kPageSize || slot_h > kPageSize) {
+    ERROR("Glyph {} of font {} is too large for the glyph cache ({}x{})", glyph, font.id, bitmap.width, bitmap.height);
+    return nullptr;
+  }
+  auto slot = allocate(slot_w, slot_h);
+  if (!slot) return nullptr;
+  auto [page, slot_pos] = *slot;
+
+  // Upload the whole slot, gap included, pages are never cleared
+  std::vector<uint8_t> texels(slot_w * slot_h, 0);
+  for (int y = 0; y < bitmap.height; y++)
+    std::memcpy(&texels[(y + kGlyphGap) * slot_w + kGlyphGap], &bitmap.pixels[y * bitmap.width], bitmap.width);
+  gl_state().bind_texture(0, page->texture.id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, slot_pos.x, slot_pos.y, slot_w, slot_h, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+  render_stats().glyph_uploads++;
+  const glm::ivec2 pos = slot_pos + kGlyphGap;
+
+  page->last_used = frame_;
+  page->glyphs.push_back(key);
+  const glm::vec4 texrect = glm::vec4(pos.x, pos.y, pos.x + bitmap.width, pos.y + bitmap.height) / (float)kPageSize;
+  auto entry = Entry{ .glyph = CachedGlyph{ .page = &page->texture, .texrect = texrect, .quad = bitmap.quad }, .page = page };
+  return &glyphs_.emplace(key, entry).first->second.glyph;
+}
+
+/// Mark the end of the frame, releasing pages over the budget that weren't drawn from this frame
+void GlyphCache::end_frame()
+{
+  for (size_t i = pages_.size(); i-- > 0 && pages_.size() > max_pages_;) {
+    Page& page = *pages_[i];
+    if (page.last_used >= frame_) continue;
+    DEBUG("Releasing glyph cache page [{}] over the budget of {} pages", page.texture.id, max_pages_);
+    for (uint64_t key : page.glyphs)
+      glyphs_.erase(key);
+    pages_.erase(pages_.begin() + i);
+  }
+  frame_++;
+}
+
+/// Find room for a w by h rect, evicting a page if needed
+auto GlyphCache::allocate(int w, int h) -> std::optional<std::pair<Page*, glm::ivec2>>
+{
+  for (auto& page : pages_)
+    if (auto pos = allocate_in(*page, w, h)) return std::pair(page.get(), *pos);
+
+  Page* page = nullptr;
+  if (pages_.size() < max_pages_) {
+    page = pages_.emplace_back(create_page()).get();
+  } else {
+    // Reuse the least recently used page, unless all are drawn this frame and their glyphs are needed
+    for (auto& candidate : pages_)
+      if (candidate->last_used < frame_ && (!page || candidate->last_used < page->last_used)) page = candidate.get();
+    if (page) {
+      clear_page(*page);
+    } else {
+      WARN("Glyph cache over its budget of {} pages, all of them are drawn this frame", max_pages_);
+      page = pages_.emplace_back(create_page()).get();
+    }
+  }
+  auto pos = allocate_in(*page, w, h);
+  if (!pos) return std::nullopt;
+  return std::pair(page, *pos);
+}
+
+/// Find room for a w by h rect in the page's shelves
+auto GlyphCache::allocate_in(Page& page, int w, int h) -> std::optional<glm::ivec2>
+{
+  // Best fit among shelves tall enough with room left, so short glyphs don't waste tall shelves
+  Shelf* best = nullptr;
+  for (Shelf& shelf : page.shelves)
+    if (shelf.height >= h && shelf.x + w <= kPageSize && (!best || shelf.height < best->height)) best = &shelf;
+  // Open a new shelf instead when the best one would waste more than half of its height
+  if ((!best || best->height > 2 * h) && page.bottom + h <= kPageSize) {
+    best = &page.shelves.emplace_back(Shelf{ .y = page.bottom, .height = h, .x = 0 });
+    page.bottom += h;
+  }
+  if (!best) return std::nullopt;
+  const glm::ivec2 pos = { best->x, best->y };
+  best->x += w;
+  return pos;
+}
+
+/// Create a page, its texels are undefined until glyphs are uploaded
+auto GlyphCache::create_page() -> std::unique_ptr<Page>
+{
+  GLuint texture;
+  glGenTextures(1, &texture);
+  gl_state().bind_texture(0, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, kPageSize, kPageSize, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+  DEBUG("Created glyph cache page [{}]", texture);
+  return std::make_unique<Page>(Page{ .texture = GLTexture{ texture } });
+}
+
+/// Drop all glyphs of the page, new glyphs overwrite its texels
+void GlyphCache::clear_page(Page& page)
+{
+  DEBUG("Evicting glyph cache page [{}] with {} glyphs", page.texture.id, page.glyphs.size());
+  for (uint64_t key : page.glyphs)
+    glyphs_.erase(key);
+  page.glyphs.clear();
+  page.shelves.clear();
+  page.bottom = 0;
+}
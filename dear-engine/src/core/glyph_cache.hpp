@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include "gl_font.hpp"
+#include "gl_texture.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Glyph Cache
+
+/// A glyph rasterized into a GlyphCache page
+struct CachedGlyph {
+  const GLTexture* page = nullptr; // null for blank glyphs, like space
+  glm::vec4 texrect;               // texture coordinates rect (s0, t0, s1, t1) in the page
+  glm::vec4 quad;                  // glyph quad (x0, y0, x1, y1) relative to the pen, in font pixels
+};
+
+/// GlyphCache rasterizes glyphs of any font on first use into single channel atlas pages shared by all fonts,
+/// uploading each one on its own with glTexSubImage2D. Pages are filled in shelves, and once the page budget is
+/// reached the least recently used page not drawn this frame is cleared and reused, so large character sets
+/// only take the memory of the glyphs recently drawn. A frame drawing more glyphs than fit in the budget gets
+/// extra pages, released again once a frame goes by without drawing from them.
+class GlyphCache final {
+ public:
+  /// Width and height of a page, in texels
+  static constexpr int kPageSize = 1024;
+  /// Default page budget, 1 MiB each
+  static constexpr size_t kMaxPages = 4;
+
+  explicit GlyphCache(size_t max_pages = kMaxPages) : max_pages_(max_pages) {}
+
+  // Movable but not Copyable
+  GlyphCache(GlyphCache&&) = default;
+  GlyphCache(const GlyphCache&) = delete;
+  GlyphCache& operator=(GlyphCache&&) = default;
+  GlyphCache& operator=(const GlyphCache&) = delete;
+
+  /// Get a glyph of the font by glyph index, rasterizing and uploading it on first use.
+  /// Returns null when the glyph can't be rasterized or is larger than a page.
+  /// Pointers are valid until the next call to get().
+  auto get(const GLFont& font, int glyph) -> const CachedGlyph*;
+
+  /// Mark the end of the frame, pages used from now on count as used by the next one.
+  /// Releases pages over the budget that weren't drawn from this frame.
+  void end_frame();
+
+  /// Number of pages allocated
+  [[nodiscard]] size_t num_pages() const { return pages_.size(); }
+
+ private:
+  /// Row of glyphs of up to height texels, filled left to right
+  struct Shelf {
+    int y;
+    int height;
+    int x;
+  };
+
+  /// Atlas page and the glyphs rasterized into it
+  struct Page {
+    GLTexture texture;
+    std::vector<Shelf> shelves;
+    int bottom = 0;                  // y where the next shelf starts
+    uint64_t last_used = 0;          // frame of the last glyph lookup
+    std::vector<uint64_t> glyphs;    // keys of the cached glyphs in it
+  };
+
+  /// Find room for a w by h rect, evicting a page if needed, returns the page and rect position
+  auto allocate(int w, int h) -> std::optional<std::pair<Page*, glm::ivec2>>;
+
+  /// Find room for a w by h rect in the page's shelves
+  static auto allocate_in(Page& page, int w, int h) -> std::optional<glm::ivec2>;
+
+  /// Create a page, its texels are undefined until glyphs are uploaded
+  static auto create_page() -> std::unique_ptr<Page>;
+
+  /// Drop all glyphs of the page, new glyphs overwrite its texels
+  void clear_page(Page& page);
+
+  /// Cached glyph and the page holding it, null for blank glyphs
+  struct Entry {
+    CachedGlyph glyph;
+    Page* page;
+  };
+
+ private:
+  std::vector<std::unique_ptr<Page>> pages_;
+  std::unordered_map<uint64_t, Entry> glyphs_; // by font id << 32 | glyph index
+  size_t max_pages_;
+  uint64_t frame_ = 1;
+};
@@ -0,0 +1,87 @@
+#include "hitch_trace.hpp"
+
+#include <ctime>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "log.hpp"
+#include "profiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Hitch Trace
+
+HitchDetector::HitchDetector(std::string outdir, float factor)
+    : outdir_(std::move(outdir)), factor_(factor)
+{
+  INFO("Hitch trace capture enabled: frames over {}x the median are saved to '{}'", factor_, outdir_);
+}
+
+bool HitchDetector::update(const Profiler& profiler, float frame_time)
+{
+  times_[count_ % kWindow] = frame_time;
+  count_++;
+  if (count_ >= kWindow && count_ % kMedianPeriod == 0) {
+    auto sorted = times_;
+    std::nth_element(sorted.begin(), sorted.begin() + kWindow / 2, sorted.end());
+    median_ = sorted[kWindow / 2];
+  }
+  // cooldown skips the loading frames at startup and the frames already saved in a previous trace
+  if (cooldown_) { cooldown_--; return false; }
+  if (median_ <= 0.0f || frame_time <= factor_ * median_) return false;
+  cooldown_ = Profiler::kHistory;
+  return save_trace(profiler, frame_time);
+}
+
+bool HitchDetector::save_trace(const Profiler& profiler, float frame_time)
+{
+  const size_t num_frames = profiler.history_size();
+  if (!num_frames) return false;
+  const ProfileFrame& hitch = profiler.frame(0);
+
+  char timestamp[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+  std::error_code ec;
+  std::filesystem::create_directories(outdir_, ec);
+  const auto filepath = std::filesystem::path(outdir_) / fmt::format("hitch-{}-f{}.json", timestamp, hitch.number);
+  std::ofstream out(filepath);
+  if (!out) { ERROR("Failed to open hitch trace file ({})", filepath.string()); return false; }
+
+  const int64_t base_ns = profiler.frame(num_frames - 1).begin_ns;
+  auto us = [base_ns](int64_t ns) { return (ns - base_ns) / 1000.0; };
+  out << "{\"traceEvents\":[\n";
+  for (size_t age = num_frames; age-- > 0;) {
+    const ProfileFrame& frame = profiler.frame(age);
+    out << fmt::format(R"({{"name":"frame {}","cat":"frame","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":0,"tid":0}},)""\n",
+                       frame.number, us(frame.begin_ns), (frame.end_ns - frame.begin_ns) / 1000.0);
+    for (const ProfileZone& zone : frame.zones) {
+      out << fmt::format(R"({{"name":"{}","cat":"zone","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":0,"tid":{})",
+                         zone.name, us(zone.begin_ns), (zone.end_ns - zone.begin_ns) / 1000.0, zone.thread);
+      if (zone.perf.cycles) {
+        out << fmt::format(R"(,"args":{{"cycles":{},"instructions":{},"cache_misses":{},"branch_misses":{},"ipc":{:.3f}}})",
+                           zone.perf.cycles, zone.perf.instructions, zone.perf.cache_misses, zone.perf.branch_misses, zone.perf.ipc());
+      }
+      out << "},\n";
+    }
+    out << fmt::format(R"({{"name":"allocs","ph":"C","ts":{:.3f},"pid":0,"args":{{"count":{},"bytes":{}}}}},)""\n",
+                       us(frame.end_ns), frame.allocs.count, frame.allocs.bytes);
+    out << fmt::format(R"({{"name":"gl","ph":"C","ts":{:.3f},"pid":0,"args":{{"draw_calls":{},"elements":{},"texture_binds":{},"vao_binds":{},"instances":{},"instances_dropped":{},"gl_calls_issued":{},"gl_calls_skipped":{},"stream_bytes":{},"stream_waits":{},"glyph_uploads":{},"resolution_scale":{:.3f}}}}})",
+                       us(frame.end_ns), frame.render.draw_calls, frame.render.elements, frame.render.texture_binds, frame.render.vao_binds,
+                       frame.render.instances, frame.render.instances_dropped, frame.render.gl_calls_issued, frame.render.gl_calls_skipped,
+                       frame.render.stream_bytes, frame.render.stream_waits, frame.render.glyph_uploads,
+                       frame.render.resolution_scale);
+    out << (age ? ",\n" : "\n");
+  }
+  out << "],\n";
+  out << fmt::format(R"("otherData":{{"hitch_frame":{},"frame_time_ms":{:.3f},"median_ms":{:.3f},"factor":{}}})""\n}}\n",
+                     hitch.number, frame_time * 1000.f, median_ * 1000.f, factor_);
+  out.close();
+
+  WARN("Hitch on frame {}: {:.3f} ms (median {:.3f} ms), trace saved to '{}'",
+       hitch.number, frame_time * 1000.f, median_ * 1000.f, filepath.string());
+  return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "profiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Hitch Trace
+
+/// Watches frame times and, when a frame takes longer than `factor` times the median frame,
+/// saves the profiler history (zones, allocation counts, GL stats) to a timestamped trace file.
+/// The trace is in Chrome Trace Event format, open it with chrome://tracing or ui.perfetto.dev.
+class HitchDetector final {
+ public:
+  /// Number of recent frame times used to compute the median
+  static constexpr size_t kWindow = 128;
+  /// Frames between median re-computations
+  static constexpr size_t kMedianPeriod = 32;
+
+  explicit HitchDetector(std::string outdir, float factor = 2.0f);
+
+  /// Feed the last frame time in seconds, returns true if a hitch trace was saved.
+  /// Cheap in the common case: a ring buffer store and a compare against the cached threshold.
+  bool update(const Profiler& profiler, float frame_time);
+
+ private:
+  /// Write the profiler history to a new trace file
+  bool save_trace(const Profiler& profiler, float frame_time);
+
+ private:
+  std::string outdir_;
+  float factor_;
+  std::array<float, kWindow> times_{};
+  size_t count_ = 0;
+  float median_ = 0.0f;
+  size_t cooldown_ = Profiler::kHistory;
+};
@@ -0,0 +1,28 @@
+#include "imgui_frame.hpp"
+
+#include <imgui/imgui.h>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ImGui Frame
+
+void ImGuiFrame::copy(const ImDrawData& src)
+{
+  clear();
+  lists_.reserve(src.CmdListsCount);
+  for (int i = 0; i < src.CmdListsCount; i++)
+    lists_.push_back(src.CmdLists[i]->CloneOutput());
+  data_ = src;
+  // Point at the owned clones, never at ImGui's own list array
+  data_.CmdLists = lists_.data();
+  data_.CmdListsCount = (int)lists_.size();
+}
+
+void ImGuiFrame::clear()
+{
+  for (ImDrawList* list : lists_)
+    IM_DELETE(list);
+  lists_.clear();
+  data_.CmdLists = nullptr;
+  data_.CmdListsCount = 0;
+  data_.Valid = false;
+}
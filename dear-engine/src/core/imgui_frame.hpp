@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <imgui/imgui.h>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ImGui Frame
+
+/// Deep copy of ImGui draw data, so a frame built on one thread can be rendered on another
+/// while the next one is being built. Owns the cloned draw lists.
+class ImGuiFrame final {
+ public:
+  ImGuiFrame() = default;
+  ~ImGuiFrame() { clear(); }
+
+  // Not Copyable or Movable
+  ImGuiFrame(const ImGuiFrame&) = delete;
+  ImGuiFrame& operator=(const ImGuiFrame&) = delete;
+
+  /// Replace contents with a copy of the draw data
+  void copy(const ImDrawData& src);
+
+  /// Release the draw lists
+  void clear();
+
+  /// Get the copied draw data, valid until the next copy or clear
+  [[nodiscard]] ImDrawData* data() { return &data_; }
+
+ private:
+  ImDrawData data_;
+  std::vector<ImDrawList*> lists_; // cloned draw lists, owned
+};
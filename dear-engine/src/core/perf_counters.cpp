@@ -0,0 +1,98 @@
+#include "perf_counters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <optional>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "log.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Perf Counters
+
+#ifdef __linux__
+
+/// Open a hardware counter for the calling thread on any cpu
+static int open_hw_counter(uint64_t config, int group_fd)
+{
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = (group_fd == -1); // only the leader starts disabled, members follow it
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &attr, 0 /*this thread*/, -1 /*any cpu*/, group_fd, 0);
+}
+
+PerfCounterGroup::~PerfCounterGroup()
+{
+  for (int fd : fds_)
+    if (fd != -1) close(fd);
+}
+
+auto PerfCounterGroup::open() -> std::optional<PerfCounterGroup>
+{
+  constexpr uint64_t kConfigs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+  PerfCounterGroup group;
+  for (size_t i = 0; i < std::size(kConfigs); i++) {
+    group.fds_[i] = open_hw_counter(kConfigs[i], group.fds_[0]);
+    if (group.fds_[i] == -1) {
+      WARN("Failed to open hardware perf counter {} ({}), check /proc/sys/kernel/perf_event_paranoid", i, std::strerror(errno));
+      return std::nullopt;
+    }
+  }
+  ioctl(group.fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group.fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return group;
+}
+
+auto PerfCounterGroup::read() const -> PerfCounts
+{
+  // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, values[nr]
+  uint64_t data[3 + 4];
+  if (::read(fds_[0], data, sizeof(data)) != (ssize_t)sizeof(data)) return {};
+  const uint64_t enabled = data[1];
+  const uint64_t running = data[2];
+  auto scaled = [&](uint64_t value) -> uint64_t {
+    if (running == 0 || running == enabled) return value;
+    return (uint64_t)((double)value * enabled / running);
+  };
+  return PerfCounts{
+    .cycles = scaled(data[3]),
+    .instructions = scaled(data[4]),
+    .cache_misses = scaled(data[5]),
+    .branch_misses = scaled(data[6]),
+  };
+}
+
+#else // !__linux__
+
+PerfCounterGroup::~PerfCounterGroup() = default;
+
+auto PerfCounterGroup::open() -> std::optional<PerfCounterGroup>
+{
+  WARN("Hardware perf counters are only supported on Linux");
+  return std::nullopt;
+}
+
+auto PerfCounterGroup::read() const -> PerfCounts
+{
+  return {};
+}
+
+#endif // __linux__
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <optional>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Perf Counters
+
+/// Hardware performance counter values
+struct PerfCounts {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  uint64_t branch_misses = 0;
+
+  /// Instructions per cycle
+  [[nodiscard]] double ipc() const { return cycles ? (double)instructions / cycles : 0.0; }
+  /// Cache misses per thousand instructions
+  [[nodiscard]] double cache_mpki() const { return instructions ? cache_misses * 1000.0 / instructions : 0.0; }
+  /// Branch misses per thousand instructions
+  [[nodiscard]] double branch_mpki() const { return instructions ? branch_misses * 1000.0 / instructions : 0.0; }
+};
+
+inline PerfCounts operator-(const PerfCounts& a, const PerfCounts& b) {
+  return { a.cycles - b.cycles, a.instructions - b.instructions, a.cache_misses - b.cache_misses, a.branch_misses - b.branch_misses };
+}
+
+inline PerfCounts& operator+=(PerfCounts& a, const PerfCounts& b) {
+  a.cycles += b.cycles;
+  a.instructions += b.instructions;
+  a.cache_misses += b.cache_misses;
+  a.branch_misses += b.branch_misses;
+  return a;
+}
+
+/// Group of hardware counters (cycles, instructions, cache misses, branch misses) measuring the thread that opened it.
+/// Backed by Linux perf_event_open, the group is scheduled on the PMU as a unit so the values are consistent.
+class PerfCounterGroup final {
+  PerfCounterGroup() = default;
+
+ public:
+  ~PerfCounterGroup();
+
+  // Movable but not Copyable
+  PerfCounterGroup(PerfCounterGroup&& o) noexcept : fds_(std::exchange(o.fds_, kClosed)) {}
+  PerfCounterGroup(const PerfCounterGroup&) = delete;
+  PerfCounterGroup& operator=(PerfCounterGroup&& o) noexcept { std::swap(fds_, o.fds_); return *this; }
+  PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+  /// Open and start counting for the calling thread, fails when unsupported by the platform or permissions
+  static auto open() -> std::optional<PerfCounterGroup>;
+
+  /// Read current counter values since open, scaled in case the PMU was multiplexed
+  [[nodiscard]] auto read() const -> PerfCounts;
+
+ private:
+  static constexpr std::array<int, 4> kClosed = { -1, -1, -1, -1 };
+  /// Event file descriptors: group leader cycles, instructions, cache misses, branch misses
+  std::array<int, 4> fds_ = kClosed;
+};
@@ -0,0 +1,122 @@
+#include "profiler.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include "log.hpp"
+#include "renderer.hpp"
+#include "alloc_stats.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Profiler
+
+Profiler::Profiler()
+    : epoch_(std::chrono::steady_clock::now()), frames_(kHistory), last_allocs_(alloc_stats())
+{
+  for (auto& frame : frames_)
+    frame.zones.reserve(256);
+}
+
+int64_t Profiler::now_ns() const
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+ZoneMark Profiler::begin_zone()
+{
+  ThreadBuffer& buffer = thread_buffer();
+  buffer.depth++;
+  ZoneMark mark;
+  mark.ns = now_ns();
+  // counters are read last on begin and first on end to leave the profiler overhead out of the zone
+  if (perf_enabled_) mark.perf = read_perf(buffer);
+  return mark;
+}
+
+void Profiler::end_zone(const char* name, const ZoneMark& begin)
+{
+  ThreadBuffer& buffer = thread_buffer();
+  const PerfCounts perf = perf_enabled_ ? read_perf(buffer) - begin.perf : PerfCounts{};
+  const int64_t end_ns = now_ns();
+  buffer.depth--;
+  std::lock_guard lock(buffer.mutex);
+  buffer.zones.push_back(ProfileZone{
+    .name = name,
+    .thread = buffer.index,
+    .depth = buffer.depth,
+    .begin_ns = begin.ns,
+    .end_ns = end_ns,
+    .perf = perf,
+  });
+}
+
+void Profiler::end_frame(const RenderStats& render)
+{
+  ProfileFrame& frame = frames_[frame_count_ % kHistory];
+  frame.zones.clear();
+  {
+    std::lock_guard threads_lock(threads_mutex_);
+    for (auto& buffer : threads_) {
+      std::lock_guard lock(buffer->mutex);
+      frame.zones.insert(frame.zones.end(), buffer->zones.begin(), buffer->zones.end());
+      buffer->zones.clear();
+    }
+  }
+  const AllocStats allocs = alloc_stats();
+  frame.number = frame_count_;
+  frame.begin_ns = frame_begin_ns_;
+  frame.end_ns = now_ns();
+  frame.allocs = AllocStats{
+    .count = allocs.count - last_allocs_.count,
+    .bytes = allocs.bytes - last_allocs_.bytes,
+  };
+  frame.render = render;
+  last_allocs_ = allocs;
+  frame_begin_ns_ = frame.end_ns;
+  frame_count_++;
+}
+
+const ProfileFrame& Profiler::frame(size_t age) const
+{
+  ASSERT(age < history_size());
+  return frames_[(frame_count_ - 1 - age) % kHistory];
+}
+
+size_t Profiler::history_size() const
+{
+  return std::min<size_t>(frame_count_, kHistory);
+}
+
+Profiler::ThreadBuffer& Profiler::thread_buffer()
+{
+  // There is a single global profiler, so a plain thread_local pointer suffices
+  thread_local ThreadBuffer* tls_buffer = nullptr;
+  if (!tls_buffer) {
+    std::lock_guard lock(threads_mutex_);
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->index = threads_.size();
+    buffer->depth = 0;
+    buffer->zones.reserve(256);
+    buffer->perf_tried = false;
+    tls_buffer = threads_.emplace_back(std::move(buffer)).get();
+  }
+  return *tls_buffer;
+}
+
+PerfCounts Profiler::read_perf(ThreadBuffer& buffer)
+{
+  if (!buffer.perf_tried) {
+    buffer.perf_tried = true;
+    buffer.perf = PerfCounterGroup::open();
+    if (buffer.perf) DEBUG("Opened perf counters for profiler thread {}", buffer.index);
+  }
+  return buffer.perf ? buffer.perf->read() : PerfCounts{};
+}
+
+/// Get the global engine profiler
+auto profiler() -> Profiler&
+{
+  static Profiler profiler;
+  return profiler;
+}
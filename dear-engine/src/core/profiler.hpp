@@ -0,0 +1,133 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "renderer.hpp"
+#include "alloc_stats.hpp"
+#include "perf_counters.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Profiler
+
+/// A timed region of code recorded by the profiler
+struct ProfileZone {
+  const char* name;  // static string, not owned
+  uint32_t thread;   // profiler thread index, in order of first zone recorded
+  uint32_t depth;    // nesting level within its thread
+  int64_t begin_ns;  // nanoseconds since profiler epoch
+  int64_t end_ns;    // nanoseconds since profiler epoch
+  PerfCounts perf;   // hardware counters within the zone, zero when perf counters are disabled
+};
+
+/// Start point of a zone being recorded
+struct ZoneMark {
+  int64_t ns = -1;
+  PerfCounts perf;
+};
+
+/// Everything recorded by the profiler between two frame ends
+struct ProfileFrame {
+  uint64_t number = 0;
+  int64_t begin_ns = 0;
+  int64_t end_ns = 0;
+  std::vector<ProfileZone> zones;
+  AllocStats allocs;  // heap allocations made during the frame
+  RenderStats render; // GL work issued during the frame
+};
+
+/// Records zones from any thread and keeps the last kHistory frames in a ring buffer.
+/// Buffers are reused frame to frame, so recording does not allocate once warmed up.
+class Profiler final {
+ public:
+  /// Number of frames kept in history
+  static constexpr size_t kHistory = 120;
+
+  Profiler();
+
+  /// Nanoseconds elapsed since profiler epoch
+  [[nodiscard]] int64_t now_ns() const;
+
+  /// Enter a zone on the calling thread, returns its start point
+  ZoneMark begin_zone();
+
+  /// Leave a zone on the calling thread, recording it with its start point
+  void end_zone(const char* name, const ZoneMark& begin);
+
+  /// Close the current frame, collecting zones of all threads into the history
+  void end_frame(const RenderStats& render);
+
+  /// Number of frames closed so far
+  [[nodiscard]] uint64_t frame_count() const { return frame_count_; }
+
+  /// Get a frame from history, age 0 is the last closed frame, must be less than history_size()
+  [[nodiscard]] const ProfileFrame& frame(size_t age) const;
+
+  /// Number of frames available in history
+  [[nodiscard]] size_t history_size() const;
+
+  /// Enable/disable zone recording, disabled by default so zones cost a single flag check until something reads them
+  void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+  [[nodiscard]] bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  /// Enable/disable hardware perf counters per zone, each thread opens its own counter group on its next zone
+  void set_perf_counters(bool enabled) { perf_enabled_ = enabled; }
+  [[nodiscard]] bool perf_counters() const { return perf_enabled_; }
+
+ private:
+  /// Per-thread zone buffer, owned by the profiler and reached through a thread_local pointer
+  struct ThreadBuffer {
+    std::mutex mutex;
+    uint32_t index;
+    uint32_t depth;
+    std::vector<ProfileZone> zones;
+    std::optional<PerfCounterGroup> perf;
+    bool perf_tried;
+  };
+
+  /// Get the calling thread's buffer, registering it on first use
+  ThreadBuffer& thread_buffer();
+
+  /// Read the calling thread's perf counters, opening them on first use
+  PerfCounts read_perf(ThreadBuffer& buffer);
+
+ private:
+  std::atomic<bool> enabled_ = false;  // read by every thread entering a zone
+  bool perf_enabled_ = false;
+  std::chrono::steady_clock::time_point epoch_;
+  std::mutex threads_mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+  std::vector<ProfileFrame> frames_;
+  uint64_t frame_count_ = 0;
+  int64_t frame_begin_ns_ = 0;
+  AllocStats last_allocs_;
+};
+
+/// Get the global engine profiler
+auto profiler() -> Profiler&;
+
+/// Records a profiler zone for the lifetime of the object
+class ProfileScope final {
+ public:
+  explicit ProfileScope(const char* name) : name_(name) {
+    if (profiler().enabled()) begin_ = profiler().begin_zone();
+  }
+  ~ProfileScope() { if (begin_.ns >= 0) profiler().end_zone(name_, begin_); }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+ private:
+  const char* name_;
+  ZoneMark begin_;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+/// Profile the enclosing scope as a zone with the given static name
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(name)
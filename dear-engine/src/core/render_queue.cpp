@@ -0,0 +1,168 @@
+#include "render_queue.hpp"
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+
+#include "camera.hpp"
+#include "gl_object.hpp"
+#include "gl_shader.hpp"
+#include "gl_state.hpp"
+#include "gl_texture.hpp"
+#include "text.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Render Queue
+
+/// Bits below the layer and depth fields, draws differing only in these may be reordered
+static constexpr int kStateKeyBits = 40;
+
+auto make_sort_key(uint8_t layer, uint16_t depth, const DrawPacket& packet) -> uint64_t
+{
+  const uint64_t shader = packet.shader ? packet.shader->id() & 0xFF : 0;
+  const uint64_t texture = packet.texture ? packet.texture->id & 0xFFFF : 0;
+  const uint64_t mesh = packet.glo ? packet.glo->vao & 0xFFFF : 0;
+  return (uint64_t)layer << 56 | (uint64_t)depth << kStateKeyBits | shader << 32 | texture << 16 | mesh;
+}
+
+void RenderQueue::submit(uint8_t layer, uint16_t depth, const DrawPacket& packet)
+{
+  const uint32_t group = (uint32_t)layer << 16 | depth;
+  const auto index = (uint32_t)packets_.size();
+  if (packet.blend == BlendMode::ALPHA_BLEND) {
+    blended_items_.push_back(SortItem{ .key = make_sort_key(layer, depth, packet), .index = index, .group = group });
+  } else {
+    // Inverted layer and depth sort the nearest draws first
+    opaque_items_.push_back(SortItem{ .key = make_sort_key((uint8_t)~layer, (uint16_t)~depth, packet), .index = index, .group = group });
+  }
+  packets_.push_back(packet);
+}
+
+void RenderQueue::radix_sort(std::vector<SortItem>& items)
+{
+  if (items.size() < 2) return;
+  std::array<std::array<uint32_t, 256>, sizeof(uint64_t)> counts{};
+  for (const SortItem& item : items)
+    for (size_t byte = 0; byte < sizeof(uint64_t); byte++)
+      counts[byte][(item.key >> (byte * 8)) & 0xFF]++;
+  scratch_.resize(items.size());
+  for (size_t byte = 0; byte < sizeof(uint64_t); byte++) {
+    auto& count = counts[byte];
+    const int shift = byte * 8;
+    if (count[(items.front().key >> shift) & 0xFF] == items.size()) continue;
+    uint32_t offset = 0;
+    for (auto& c : count) { const uint32_t n = c; c = offset; offset += n; }
+    for (const SortItem& item : items)
+      scratch_[count[(item.key >> shift) & 0xFF]++] = item;
+    items.swap(scratch_);
+  }
+}
+
+void RenderQueue::collect_groups()
+{
+  // Both passes are sorted by group, so each contributes its distinct groups in order
+  groups_.clear();
+  for (auto it = opaque_items_.rbegin(); it != opaque_items_.rend(); it++)
+    if (groups_.empty() || groups_.back() != it->group) groups_.push_back(it->group);
+  const auto opaque_end = (std::ptrdiff_t)groups_.size();
+  for (const SortItem& item : blended_items_)
+    if (groups_.size() == (size_t)opaque_end || groups_.back() != item.group) groups_.push_back(item.group);
+  std::inplace_merge(groups_.begin(), groups_.begin() + opaque_end, groups_.end());
+  groups_.erase(std::unique(groups_.begin(), groups_.end()), groups_.end());
+}
+
+float RenderQueue::group_depth(uint32_t group) const
+{
+  const auto rank = std::lower_bound(groups_.begin(), groups_.end(), group) - groups_.begin();
+  return 1.0f - 2.0f * (float)(rank + 1) / (float)(groups_.size() + 1);
+}
+
+void RenderQueue::execute(const Camera& camera, SpriteBatch& batch, SpriteInstancer& instancer, TextBatch& text)
+{
+  radix_sort(opaque_items_);
+  radix_sort(blended_items_);
+  collect_groups();
+  GLState& state = gl_state();
+  state.enable_depth_test(GL_LEQUAL);
+
+  // Opaque pass, nearest first so hidden fragments fail the depth test before shading
+  state.disable_blend();
+  state.depth_mask(true);
+  execute_pass(opaque_items_, camera, batch, instancer, text);
+
+  // Blended pass, farthest first, hidden by opaque draws in front but not hiding each other
+  state.enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  state.depth_mask(false);
+  execute_pass(blended_items_, camera, batch, instancer, text);
+
+  state.disable_depth_test();
+  state.depth_mask(true);
+  // Later draws with these shaders must not discard fragments
+  for (const GLShader* shader : alpha_tested_) {
+    shader->bind();
+    state.uniform(shader->unif_loc(GLUnif::ALPHA_CUTOFF), 0.0f);
+  }
+  alpha_tested_.clear();
+  packets_.clear();
+  opaque_items_.clear();
+  blended_items_.clear();
+}
+
+void RenderQueue::execute_pass(const std::vector<SortItem>& items, const Camera& camera, SpriteBatch& batch,
+                               SpriteInstancer& instancer, TextBatch& text)
+{
+  GLState& state = gl_state();
+  const GLShader* bound = nullptr;
+  uint32_t group = ~0u;
+  BlendMode blend = BlendMode::ALPHA_BLEND;
+  for (const SortItem& item : items) {
+    const DrawPacket& packet = packets_[item.index];
+    // Draws of a run share the depth and alpha cutoff uniforms, batches must not cross runs
+    const bool same_run = item.group == group && packet.blend == blend;
+    if (!instancer.empty() && (packet.kind != DrawKind::INSTANCED_SPRITE || !same_run))
+      instancer.flush(*bound);
+    if (!text.empty() && (packet.kind != DrawKind::TEXT || !same_run))
+      text.flush(*bound);
+    if (!same_run)
+      batch.flush();
+    const bool rebind = packet.shader != bound;
+    if (rebind) {
+      batch.flush();
+      packet.shader->bind();
+      set_camera(*packet.shader, camera);
+      bound = packet.shader;
+    }
+    if (rebind || !same_run) {
+      const bool alpha_test = packet.blend == BlendMode::ALPHA_TEST;
+      state.uniform(bound->unif_loc(GLUnif::DEPTH), group_depth(item.group));
+      state.uniform(bound->unif_loc(GLUnif::ALPHA_CUTOFF), alpha_test ? kAlphaCutoff : 0.0f);
+      if (alpha_test && std::find(alpha_tested_.begin(), alpha_tested_.end(), bound) == alpha_tested_.end())
+        alpha_tested_.push_back(bound);
+      group = item.group;
+      blend = packet.blend;
+    }
+    switch (packet.kind) {
+      case DrawKind::SPRITE:
+        batch.draw(*packet.shader, *packet.texture, packet.model, packet.texrect);
+        break;
+      case DrawKind::INSTANCED_SPRITE:
+        instancer.add(*packet.texture, packet.model, packet.texrect);
+        break;
+      case DrawKind::TEXT:
+        text.add(*packet.font, *packet.glyphs, packet.model, packet.color, packet.outline_color, packet.outline_thickness);
+        break;
+      case DrawKind::COLORED:
+        batch.flush();
+        draw_colored_object(*packet.shader, *packet.glo, packet.model);
+        break;
+    }
+  }
+  batch.flush();
+  if (!instancer.empty()) instancer.flush(*bound);
+  if (!text.empty()) text.flush(*bound);
+}
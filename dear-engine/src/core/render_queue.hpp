@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "renderer.hpp"
+#include "gl_texture.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Render Queue
+
+/// How a draw packet is executed
+enum class DrawKind : uint8_t {
+  SPRITE,           // textured unit quad through the SpriteBatch
+  INSTANCED_SPRITE, // textured unit quad through the SpriteInstancer
+  TEXT,             // glyph layout with glyphs from the GlyphCache through the TextBatch
+  COLORED,          // colored GLObject
+};
+
+/// A draw submitted to the render queue, the objects it points to must outlive the queue's execution
+struct DrawPacket {
+  DrawKind kind = DrawKind::SPRITE;
+  BlendMode blend = BlendMode::ALPHA_BLEND;   // sprites take their texture's
+  const class GLShader* shader = nullptr;
+  const struct GLTexture* texture = nullptr;  // sprites only
+  const struct GLObject* glo = nullptr;       // colored only
+  const struct GLFont* font = nullptr;        // text only
+  const struct GlyphLayout* glyphs = nullptr; // text only
+  glm::mat4 model = glm::mat4(1.0f);
+  glm::vec4 texrect = kFullTexRect;          // sprites only
+  glm::vec4 color = glm::vec4(1.0f);         // text only
+  glm::vec4 outline_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  float outline_thickness = 0.0f;
+};
+
+/// Sort key of a draw, ordered from most to least significant:
+/// layer (8 bits), depth within layer (16 bits), shader (8 bits), texture (16 bits), mesh (16 bits).
+/// Draws with equal layer and depth may be reordered by state, so they must not overlap or must not care.
+/// GL names are truncated to their field, a collision only costs a state change, never the order.
+auto make_sort_key(uint8_t layer, uint16_t depth, const DrawPacket& packet) -> uint64_t;
+
+/// RenderQueue collects a frame's draws, sorts them by key and executes them with the least state changes.
+/// Opaque and alpha-tested draws are executed first, front-to-back with depth writes and no blending, so the GPU
+/// skips the fragments hidden behind them. Blended draws follow back-to-front, depth tested against the opaque ones.
+/// Each layer and depth pair gets its own depth value, set through the GLUnif::DEPTH uniform of the draw's shader.
+class RenderQueue final {
+ public:
+  RenderQueue() = default;
+
+  // Movable but not Copyable
+  RenderQueue(RenderQueue&&) = default;
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(RenderQueue&&) = default;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+  /// Queue a draw in the given layer and depth, draws of equal key keep submission order
+  void submit(uint8_t layer, uint16_t depth, const DrawPacket& packet);
+
+  /// Number of draws queued
+  [[nodiscard]] size_t size() const { return packets_.size(); }
+
+  /// Sort the queued draws and execute them, binding each shader with the camera, then clear the queue.
+  /// Leaves the last used shader bound, blending enabled and depth testing disabled.
+  void execute(const struct Camera& camera, SpriteBatch& batch, SpriteInstancer& instancer, TextBatch& text);
+
+ private:
+  /// Sort key and index of a packet, sorted instead of the packets themselves
+  struct SortItem {
+    uint64_t key;
+    uint32_t index;
+    uint32_t group; // layer << 16 | depth
+  };
+
+  /// Stable LSD radix sort of items by key, one pass per key byte, skipping bytes equal across all keys
+  void radix_sort(std::vector<SortItem>& items);
+
+  /// Collect the distinct layer and depth groups of both passes in back-to-front order
+  void collect_groups();
+
+  /// Depth value of a group, from +1 behind all draws to -1 in front of all
+  [[nodiscard]] float group_depth(uint32_t group) const;
+
+  /// Execute the sorted items of one pass
+  void execute_pass(const std::vector<SortItem>& items, const struct Camera& camera, SpriteBatch& batch,
+                    SpriteInstancer& instancer, TextBatch& text);
+
+ private:
+  std::vector<DrawPacket> packets_;
+  std::vector<SortItem> opaque_items_; // front-to-back, depth written
+  std::vector<SortItem> blended_items_; // back-to-front, depth tested only
+  std::vector<SortItem> scratch_;
+  std::vector<uint32_t> groups_;
+  std::vector<const class GLShader*> alpha_tested_; // shaders left with an alpha cutoff set
+};
@@ -0,0 +1,117 @@
+#include "render_target.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+
+#include "log.hpp"
+#include "gl_state.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Render Target
+
+RenderTarget::~RenderTarget()
+{
+  gl_release(GLKind::FRAMEBUFFER, fbo_);
+  gl_release(GLKind::TEXTURE, color_);
+  gl_release(GLKind::RENDERBUFFER, depth_);
+}
+
+/// Create the framebuffer with room for up to size pixels
+auto RenderTarget::create(glm::uvec2 size) -> std::optional<RenderTarget>
+{
+  RenderTarget target;
+  target.capacity_ = size;
+
+  GLuint color;
+  glGenTextures(1, &color);
+  target.color_ = color;
+  gl_state().bind_texture(0, color);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+  GLuint depth;
+  glGenRenderbuffers(1, &depth);
+  target.depth_ = depth;
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+
+  GLuint fbo;
+  glGenFramebuffers(1, &fbo);
+  target.fbo_ = fbo;
+  gl_state().bind_framebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  gl_state().bind_framebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    ERROR("Render target framebuffer incomplete ({}x{}, status {:#x})", size.x, size.y, (unsigned)status);
+    return std::nullopt;
+  }
+  DEBUG("Created render target [{}] ({}x{})", fbo, size.x, size.y);
+  return target;
+}
+
+/// Bind the framebuffer for rendering size pixels of it, and clear them
+void RenderTarget::begin(glm::uvec2 size)
+{
+  size_ = glm::min(size, capacity_);
+  GLState& state = gl_state();
+  state.bind_framebuffer(GL_FRAMEBUFFER, fbo_);
+  state.viewport(0, 0, size_.x, size_.y);
+  // Clear only the pixels used, the rest of the storage is never read
+  state.enable_scissor_test(0, 0, size_.x, size_.y);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  state.disable_scissor_test();
+}
+
+/// Upscale the size pixels last rendered to the viewport of the default framebuffer
+void RenderTarget::end(const Viewport& viewport, GLenum filter)
+{
+  GLState& state = gl_state();
+  state.bind_framebuffer(GL_READ_FRAMEBUFFER, fbo_);
+  state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  const glm::uvec2 dst0 = viewport.offset;
+  const glm::uvec2 dst1 = viewport.offset + viewport.size;
+  glBlitFramebuffer(0, 0, size_.x, size_.y, dst0.x, dst0.y, dst1.x, dst1.y, GL_COLOR_BUFFER_BIT, filter);
+  state.bind_framebuffer(GL_FRAMEBUFFER, 0);
+  state.viewport(viewport.offset.x, viewport.offset.y, viewport.size.x, viewport.size.y);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Resolution Scaler
+
+/// Feed the time of the last frame, returns the scale for the next one
+float ResolutionScaler::update(float frame_ms)
+{
+  if (min_scale_ == max_scale_) return scale_;
+  sum_ms_ += frame_ms;
+  if (++frames_ < kSettleFrames) return scale_;
+  const float avg_ms = sum_ms_ / frames_;
+  sum_ms_ = 0.0f;
+  frames_ = 0;
+
+  constexpr float kLowerAbove = 1.05f; // fraction of the target over which to step down, tolerating vsync jitter
+  constexpr float kRaiseBelow = 0.8f;  // fraction of the target under which there's room for a step up
+  float scale = scale_;
+  if (avg_ms > target_ms_ * kLowerAbove)
+    scale = std::floor(scale_ * std::sqrt(target_ms_ / avg_ms) / kScaleStep) * kScaleStep;
+  else if (avg_ms < target_ms_ * kRaiseBelow)
+    scale = scale_ + kScaleStep;
+  scale = std::clamp(scale, min_scale_, max_scale_);
+  if (scale != scale_)
+    DEBUG("Resolution scale {:.3f} -> {:.3f} (frame {:.2f} ms, target {:.2f} ms)", scale_, scale, avg_ms, target_ms_);
+  scale_ = scale;
+  return scale_;
+}
+
+/// Size to render at for the viewport size
+glm::uvec2 ResolutionScaler::apply(glm::uvec2 size) const
+{
+  return glm::max(glm::uvec2(glm::vec2(size) * scale_), glm::uvec2(1));
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <optional>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+#include <glm/vec2.hpp>
+
+#include "viewport.hpp"
+#include "unique_num.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Render Target
+
+/// RenderTarget is an offscreen framebuffer with color and depth, rendered at a lower resolution than the window
+/// and upscaled to its viewport. Storage is allocated for the largest size once, smaller resolutions render into
+/// its bottom-left corner, so changing the resolution every frame costs nothing.
+class RenderTarget final {
+  RenderTarget() = default;
+
+ public:
+  ~RenderTarget();
+
+  // Movable but not Copyable
+  RenderTarget(RenderTarget&&) = default;
+  RenderTarget(const RenderTarget&) = delete;
+  RenderTarget& operator=(RenderTarget&&) = default;
+  RenderTarget& operator=(const RenderTarget&) = delete;
+
+  /// Create the framebuffer with room for up to size pixels, returns nullopt if the driver rejects it
+  static auto create(glm::uvec2 size) -> std::optional<RenderTarget>;
+
+  /// Largest size the target can render at
+  [[nodiscard]] glm::uvec2 capacity() const { return capacity_; }
+
+  /// Bind the framebuffer for rendering size pixels of it, and clear them
+  void begin(glm::uvec2 size);
+
+  /// Upscale the size pixels last rendered to the viewport of the default framebuffer with filter
+  /// (GL_NEAREST or GL_LINEAR), and leave the default framebuffer bound with the viewport set
+  void end(const Viewport& viewport, GLenum filter);
+
+ private:
+  UniqueNum<GLuint> fbo_;
+  UniqueNum<GLuint> color_;
+  UniqueNum<GLuint> depth_;
+  glm::uvec2 capacity_ = glm::uvec2(0);
+  glm::uvec2 size_ = glm::uvec2(0);
+};
+
+/// ResolutionScaler picks the internal resolution scale, per axis, that holds the frame time under a target.
+/// Fill cost goes with the pixel count, the square of the scale, so it steps down by the square root of the
+/// overshoot and steps back up only with enough headroom, waiting a few frames between changes to settle.
+class ResolutionScaler final {
+ public:
+  /// Frames to average before each change
+  static constexpr int kSettleFrames = 30;
+  /// Scale granularity, so small frame time jitter doesn't change the resolution
+  static constexpr float kScaleStep = 1.0f / 16.0f;
+
+  /// Adjust the scale between min_scale and max_scale to hold frame times under target_ms
+  ResolutionScaler(float target_ms, float min_scale = 0.5f, float max_scale = 1.0f)
+      : target_ms_(target_ms), min_scale_(min_scale), max_scale_(max_scale), scale_(max_scale) {}
+
+  /// Keep the scale fixed, disabling the automatic control
+  static auto fixed(float scale) -> ResolutionScaler { return ResolutionScaler(0.0f, scale, scale); }
+
+  /// Feed the time of the last frame, returns the scale for the next one
+  float update(float frame_ms);
+
+  /// Current scale
+  [[nodiscard]] float scale() const { return scale_; }
+
+  /// Size to render at for the viewport size, at least a pixel per axis
+  [[nodiscard]] glm::uvec2 apply(glm::uvec2 size) const;
+
+ private:
+  float target_ms_;
+  float min_scale_;
+  float max_scale_;
+  float scale_;
+  float sum_ms_ = 0.0f;
+  int frames_ = 0;
+};
@@ -2,61 +2,390 @@
 
 #include <glbinding/gl33core/gl.h>
 using namespace gl;
+#include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <iterator>
+
 #include "sprite.hpp"
 #include "gl_object.hpp"
+#include "gl_state.hpp"
 #include "gl_shader.hpp"
+#include "gl_font.hpp"
 #include "gl_texture.hpp"
+#include "stream_buffer.hpp"
+#include "glyph_cache.hpp"
+#include "text.hpp"
+
+/// Get renderer stats of the current frame of the calling thread
+auto render_stats() -> RenderStats&
+{
+  static thread_local RenderStats stats;
+  return stats;
+}
 
 /// Prepare to render
 void begin_render()
 {
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  render_stats() = RenderStats{};
+  GLState& state = gl_state();
+  state.enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  state.disable_depth_test();
+  state.depth_mask(true); // glClear only clears depth when it's writable
+  state.polygon_mode(GL_FILL);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 /// Render a colored GLObject with indices
 void draw_colored_object(const GLShader& shader, const GLObject& glo, const glm::mat4& model)
 {
-  if (shader.unif_loc(GLUnif::SUBROUTINE) != -1)
-    glUniform1i(shader.unif_loc(GLUnif::SUBROUTINE), static_cast<int>(GLSub::COLOR));
-  glUniformMatrix4fv(shader.unif_loc(GLUnif::MODEL), 1, GL_FALSE, glm::value_ptr(model));
-  glBindVertexArray(glo.vao);
+  GLState& state = gl_state();
+  state.uniform(shader.unif_loc(GLUnif::MODEL), model);
+  state.bind_vertex_array(glo.vao);
   glDrawElements(GL_LINE_LOOP, glo.num_indices, GL_UNSIGNED_SHORT, nullptr);
+  auto& stats = render_stats();
+  stats.draw_calls++;
+  stats.elements += glo.num_indices;
+}
+
+/// Render count vertices of a colored GLObject from first on as mode primitives, without indices
+void draw_colored_arrays(const GLShader& shader, const GLObject& glo, GLenum mode, size_t first, size_t count,
+                         const glm::mat4& model)
+{
+  GLState& state = gl_state();
+  state.uniform(shader.unif_loc(GLUnif::MODEL), model);
+  state.bind_vertex_array(glo.vao);
+  glDrawArrays(mode, first, count);
+  auto& stats = render_stats();
+  stats.draw_calls++;
+  stats.elements += count;
 }
 
 /// Render a textured GLObject with indices
 void draw_textured_object(const GLShader& shader, const GLTexture& texture, const GLObject& glo,
                           const glm::mat4& model, const SpriteFrame* sprite)
 {
-  if (shader.unif_loc(GLUnif::SUBROUTINE) != -1)
-    glUniform1i(shader.unif_loc(GLUnif::SUBROUTINE), static_cast<int>(GLSub::TEXTURE));
-  glUniformMatrix4fv(shader.unif_loc(GLUnif::MODEL), 1, GL_FALSE, glm::value_ptr(model));
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture.id);
-  glBindVertexArray(glo.vao);
+  GLState& state = gl_state();
+  state.uniform(shader.unif_loc(GLUnif::MODEL), model);
+  state.bind_texture(0, texture.id);
+  state.bind_vertex_array(glo.vao);
   size_t ebo_offset = sprite ? sprite->ebo_offset : 0;
   size_t ebo_count = sprite ? sprite->ebo_count : glo.num_indices;
   glDrawElements(GL_TRIANGLES, ebo_count, GL_UNSIGNED_SHORT, (const void*)ebo_offset);
+  auto& stats = render_stats();
+  stats.draw_calls++;
+  stats.elements += ebo_count;
 }
 
 /// Render a text GLObject with indices
 void draw_text_object(const GLShader& shader, const GLTexture& texture, const GLObject& glo,
                       const glm::mat4& model, const glm::vec4& color, const glm::vec4& outline_color, const float outline_thickness)
 {
-  if (shader.unif_loc(GLUnif::SUBROUTINE) != -1)
-    glUniform1i(shader.unif_loc(GLUnif::SUBROUTINE), static_cast<int>(GLSub::FONT));
-  glUniform4fv(shader.unif_loc(GLUnif::COLOR), 1, glm::value_ptr(color));
-  glUniform4fv(shader.unif_loc(GLUnif::OUTLINE_COLOR), 1, glm::value_ptr(outline_color));
-  glUniform1f(shader.unif_loc(GLUnif::OUTLINE_THICKNESS), outline_thickness);
-  glUniformMatrix4fv(shader.unif_loc(GLUnif::MODEL), 1, GL_FALSE, glm::value_ptr(model));
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture.id);
-  glBindVertexArray(glo.vao);
+  GLState& state = gl_state();
+  state.uniform(shader.unif_loc(GLUnif::COLOR), color);
+  state.uniform(shader.unif_loc(GLUnif::OUTLINE_COLOR), outline_color);
+  state.uniform(shader.unif_loc(GLUnif::OUTLINE_THICKNESS), outline_thickness);
+  state.uniform(shader.unif_loc(GLUnif::MODEL), model);
+  state.bind_texture(0, texture.id);
+  state.bind_vertex_array(glo.vao);
   glDrawElements(GL_TRIANGLES, glo.num_indices, GL_UNSIGNED_SHORT, nullptr);
+  auto& stats = render_stats();
+  stats.draw_calls++;
+  stats.elements += glo.num_indices;
+}
+
+
+SpriteBatch::SpriteBatch(GLObject glo, StreamBuffer& stream)
+    : glo_(std::move(glo)), stream_(&stream)
+{
+  vertices_.reserve(4 * kMaxSprites);
+}
+
+/// Generate indices of count consecutive quads of 4 vertices
+static auto gen_quad_indices(size_t count) -> std::vector<GLushort>
+{
+  std::vector<GLushort> indices;
+  indices.reserve(6 * count);
+  for (size_t i = 0; i < count; i++)
+    for (auto v : kQuadIndices)
+      indices.emplace_back(4*i+v);
+  return indices;
 }
 
+/// Stream quad vertices through the bound VAO's layout and draw them, max_quads at a time
+template<typename Vertex>
+static void draw_streamed_quads(StreamBuffer& stream, gsl::span<const Vertex> vertices, size_t max_quads)
+{
+  auto& stats = render_stats();
+  for (size_t first = 0; first < vertices.size(); first += 4 * max_quads) {
+    const auto chunk = vertices.subspan(first, std::min<size_t>(4 * max_quads, vertices.size() - first));
+    const auto offset = stream.write(chunk);
+    if (!offset) return;
+    const size_t num_indices = 6 * (chunk.size() / 4);
+    glDrawElementsBaseVertex(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr, *offset / sizeof(Vertex));
+    stats.draw_calls++;
+    stats.elements += num_indices;
+  }
+}
+
+/// Create the quad indices and the shader's textured vertex layout over the stream buffer
+auto SpriteBatch::create(const GLShader& shader, StreamBuffer& stream) -> SpriteBatch
+{
+  // Vertices are streamed every flush and addressed by base vertex, indices are static quads for the whole capacity
+  return SpriteBatch(create_textured_globject(shader, stream.id(), gen_quad_indices(kMaxSprites)), stream);
+}
+
+/// Queue a unit quad transformed by model, sampling texrect (s0, t0, s1, t1) of the texture
+void SpriteBatch::draw(const GLShader& shader, const GLTexture& texture, const glm::mat4& model, const glm::vec4& texrect)
+{
+  if (&shader != shader_ || &texture != texture_ || vertices_.size() >= 4 * kMaxSprites)
+    flush();
+  shader_ = &shader;
+  texture_ = &texture;
+  // 2D affine transform of the unit quad corners (see kTextureQuadVertices)
+  const glm::vec2 x_axis = glm::vec2(model[0]);
+  const glm::vec2 y_axis = glm::vec2(model[1]);
+  const glm::vec2 origin = glm::vec2(model[3]);
+  const glm::u16vec4 t = pack_texrect(texrect);
+  vertices_.emplace_back(TextureVertex{ .pos = origin + x_axis + y_axis, .texcoord = { t[2], t[3] } });
+  vertices_.emplace_back(TextureVertex{ .pos = origin + x_axis - y_axis, .texcoord = { t[2], t[1] } });
+  vertices_.emplace_back(TextureVertex{ .pos = origin - x_axis - y_axis, .texcoord = { t[0], t[1] } });
+  vertices_.emplace_back(TextureVertex{ .pos = origin - x_axis + y_axis, .texcoord = { t[0], t[3] } });
+}
+
+/// Draw all queued sprites with the bound shader
+void SpriteBatch::flush()
+{
+  if (vertices_.empty()) return;
+  const GLShader& shader = *shader_;
+  GLState& state = gl_state();
+  state.uniform(shader.unif_loc(GLUnif::MODEL), glm::mat4(1.0f));
+  state.bind_texture(0, texture_->id);
+  state.bind_vertex_array(glo_.vao);
+  draw_streamed_quads<TextureVertex>(*stream_, vertices_, kMaxSprites);
+  vertices_.clear();
+}
+
+SpriteInstancer::SpriteInstancer(GLObject glo, StreamBuffer& stream)
+    : glo_(std::move(glo)), stream_(&stream)
+{
+  staging_.reserve(kMaxInstances);
+  draws_.reserve(kMaxGroups);
+}
+
+/// Point the per-instance attributes at the given offset of the buffer bound to GL_ARRAY_BUFFER
+static void set_instance_attr_pointers(const GLShader& shader, size_t offset)
+{
+  const GLint model_loc = shader.attr_loc(GLAttr::MODEL);
+  for (GLint col = 0; col < 3; col++) // mat3x2 takes one location per column
+    glVertexAttribPointer(model_loc + col, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance),
+                          (void*)(offset + offsetof(SpriteInstance, model) + col * sizeof(glm::vec2)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::TEXRECT), 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(SpriteInstance),
+                        (void*)(offset + offsetof(SpriteInstance, texrect)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::COLOR), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance),
+                        (void*)(offset + offsetof(SpriteInstance, tint)));
+}
+
+/// Create the instanced sprite shader's instance layout over the stream buffer
+auto SpriteInstancer::create(const GLShader& shader, StreamBuffer& stream) -> SpriteInstancer
+{
+  GLObject glo = create_empty_globject();
+  gl_state().bind_vertex_array(glo.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, stream.id());
+  const GLint model_loc = shader.attr_loc(GLAttr::MODEL);
+  for (GLint col = 0; col < 3; col++) {
+    glEnableVertexAttribArray(model_loc + col);
+    glVertexAttribDivisor(model_loc + col, 1);
+  }
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::TEXRECT));
+  glVertexAttribDivisor(shader.attr_loc(GLAttr::TEXRECT), 1);
+  glEnableVertexAttribArray(shader.attr_loc(GLAttr::COLOR));
+  glVertexAttribDivisor(shader.attr_loc(GLAttr::COLOR), 1);
+  set_instance_attr_pointers(shader, 0);
+  return SpriteInstancer(std::move(glo), stream);
+}
+
+/// Queue an instance of the unit quad transformed by model, sampling texrect (s0, t0, s1, t1) of the texture
+void SpriteInstancer::add(const GLTexture& texture, const glm::mat4& model, const glm::vec4& texrect, const glm::vec4& tint)
+{
+  auto group = std::find_if(groups_.begin(), groups_.end(), [&](const Group& group) { return group.texture == &texture; });
+  if (group == groups_.end()) {
+    // Groups are kept across flushes to reuse their storage, only pruned when too many textures came by
+    if (groups_.size() >= kMaxGroups) {
+      groups_.erase(std::remove_if(groups_.begin(), groups_.end(), [](const Group& group) { return group.instances.empty(); }),
+                    groups_.end());
+    }
+    groups_.emplace_back(Group{ .texture = &texture, .instances = {} });
+    group = std::prev(groups_.end());
+  }
+  group->instances.emplace_back(SpriteInstance{
+    .model = { glm::vec2(model[0]), glm::vec2(model[1]), glm::vec2(model[3]) },
+    .texrect = pack_texrect(texrect),
+    .tint = pack_color(tint),
+  });
+  queued_++;
+}
+
+/// Draw all queued instances with the bound instanced sprite shader, one draw call per texture and upload
+void SpriteInstancer::flush(const GLShader& shader)
+{
+  if (!queued_) return;
+  queued_ = 0;
+  gl_state().bind_vertex_array(glo_.vao);
+  // Stage groups together up to kMaxInstances, each draw then points the instance attributes at its run.
+  // A full staging buffer is drawn right away and staging goes on, splitting the group across uploads.
+  staging_.clear();
+  draws_.clear();
+  for (auto& group : groups_) {
+    for (auto first = group.instances.begin(); first != group.instances.end();) {
+      if (staging_.size() == kMaxInstances) draw_staged(shader);
+      const size_t count = std::min<size_t>(kMaxInstances - staging_.size(), group.instances.end() - first);
+      staging_.insert(staging_.end(), first, first + count);
+      draws_.push_back(Draw{ .texture = group.texture, .count = count });
+      first += count;
+    }
+    group.instances.clear();
+  }
+  draw_staged(shader);
+}
+
+void SpriteInstancer::draw_staged(const GLShader& shader)
+{
+  if (staging_.empty()) return;
+  auto& stats = render_stats();
+  const auto base = stream_->write<SpriteInstance>(staging_);
+  if (base) {
+    GLState& state = gl_state();
+    size_t offset = *base;
+    for (const Draw& draw : draws_) {
+      set_instance_attr_pointers(shader, offset);
+      state.bind_texture(0, draw.texture->id);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, draw.count);
+      stats.draw_calls++;
+      stats.elements += 4 * draw.count;
+      stats.instances += draw.count;
+      offset += draw.count * sizeof(SpriteInstance);
+    }
+  } else {
+    stats.instances_dropped += staging_.size();
+  }
+  staging_.clear();
+  draws_.clear();
+}
+
+TextBatch::TextBatch(GLObject glo, StreamBuffer& stream, GlyphCache& cache)
+    : glo_(std::move(glo)), stream_(&stream), cache_(&cache)
+{
+}
+
+/// Point the glyph instance attributes at the given offset of the buffer bound to GL_ARRAY_BUFFER
+static void set_glyph_attr_pointers(const GLShader& shader, size_t offset)
+{
+  const GLint model_loc = shader.attr_loc(GLAttr::MODEL);
+  for (GLint col = 0; col < 3; col++) // mat3x2 takes one location per column
+    glVertexAttribPointer(model_loc + col, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance),
+                          (void*)(offset + offsetof(GlyphInstance, model) + col * sizeof(glm::vec2)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::TEXRECT), 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GlyphInstance),
+                        (void*)(offset + offsetof(GlyphInstance, texrect)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::COLOR), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphInstance),
+                        (void*)(offset + offsetof(GlyphInstance, color)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::OUTLINE_COLOR), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphInstance),
+                        (void*)(offset + offsetof(GlyphInstance, outline_color)));
+  glVertexAttribPointer(shader.attr_loc(GLAttr::OUTLINE_THICKNESS), 1, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance),
+                        (void*)(offset + offsetof(GlyphInstance, outline_thickness)));
+}
+
+/// Create the text shader's glyph instance layout over the stream buffer
+auto TextBatch::create(const GLShader& shader, StreamBuffer& stream, GlyphCache& cache) -> TextBatch
+{
+  GLObject glo = create_empty_globject();
+  gl_state().bind_vertex_array(glo.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, stream.id());
+  const GLint model_loc = shader.attr_loc(GLAttr::MODEL);
+  for (GLint col = 0; col < 3; col++) {
+    glEnableVertexAttribArray(model_loc + col);
+    glVertexAttribDivisor(model_loc + col, 1);
+  }
+  for (GLAttr attr : { GLAttr::TEXRECT, GLAttr::COLOR, GLAttr::OUTLINE_COLOR, GLAttr::OUTLINE_THICKNESS }) {
+    glEnableVertexAttribArray(shader.attr_loc(attr));
+    glVertexAttribDivisor(shader.attr_loc(attr), 1);
+  }
+  set_glyph_attr_pointers(shader, 0);
+  return TextBatch(std::move(glo), stream, cache);
+}
+
+/// Queue the glyphs of a layout for the font, transformed by model
+void TextBatch::add(const GLFont& font, const GlyphLayout& layout, const glm::mat4& model,
+                    const glm::vec4& color, const glm::vec4& outline_color, float outline_thickness)
+{
+  // 2D affine transform of the glyph quads, the style goes along in every instance
+  const glm::vec2 x_axis = glm::vec2(model[0]);
+  const glm::vec2 y_axis = glm::vec2(model[1]);
+  const glm::vec2 origin = glm::vec2(model[3]);
+  const glm::u8vec4 color8 = pack_color(color);
+  const glm::u8vec4 outline_color8 = pack_color(outline_color);
+  Batch* batch = nullptr;
+  for (const GlyphLayout::Glyph& glyph : layout.glyphs) {
+    const CachedGlyph* cached = cache_->get(font, glyph.index);
+    if (!cached || !cached->page) continue;
+    // Consecutive glyphs nearly always share a page, only search the batches when it changes
+    if (!batch || batch->page != cached->page || batch->sdf_spread != font.sdf_spread)
+      batch = &find_batch(*cached->page, font.sdf_spread);
+    // Unit square corner (0,0) goes to the quad's (x0, y0), sampling (s0, t0)
+    const glm::vec4& q = cached->quad;
+    batch->instances.emplace_back(GlyphInstance{
+      .model = { x_axis * (q[2] - q[0]), y_axis * (q[3] - q[1]), origin + x_axis * (glyph.x + q[0]) + y_axis * (glyph.y + q[1]) },
+      .texrect = pack_texrect(cached->texrect),
+      .color = color8,
+      .outline_color = outline_color8,
+      .outline_thickness = outline_thickness,
+    });
+    queued_++;
+  }
+}
+
+/// Get the batch of glyphs in the page with the SDF spread, adding it if new
+auto TextBatch::find_batch(const GLTexture& page, float sdf_spread) -> Batch&
+{
+  auto batch = std::find_if(batches_.begin(), batches_.end(),
+                            [&](const Batch& batch) { return batch.page == &page && batch.sdf_spread == sdf_spread; });
+  if (batch != batches_.end()) return *batch;
+  // Batches are kept across flushes to reuse their storage, only pruned when too many pages came by
+  if (batches_.size() >= kMaxBatches) {
+    batches_.erase(std::remove_if(batches_.begin(), batches_.end(), [](const Batch& batch) { return batch.instances.empty(); }),
+                   batches_.end());
+  }
+  return batches_.emplace_back(Batch{ .page = &page, .sdf_spread = sdf_spread, .instances = {} });
+}
+
+/// Draw all queued glyphs with the bound text shader, one draw call per glyph cache page and font kind
+void TextBatch::flush(const GLShader& shader)
+{
+  if (!queued_) return;
+  queued_ = 0;
+  GLState& state = gl_state();
+  state.bind_vertex_array(glo_.vao);
+  auto& stats = render_stats();
+  for (auto& batch : batches_) {
+    if (batch.instances.empty()) continue;
+    state.uniform(shader.unif_loc(GLUnif::SDF_SPREAD), batch.sdf_spread);
+    state.bind_texture(0, batch.page->id);
+    const gsl::span<const GlyphInstance> instances = batch.instances;
+    for (size_t first = 0; first < instances.size(); first += kMaxGlyphs) {
+      const auto chunk = instances.subspan(first, std::min<size_t>(kMaxGlyphs, instances.size() - first));
+      const auto offset = stream_->write(chunk);
+      if (!offset) {
+        stats.instances_dropped += instances.size() - first;
+        break;
+      }
+      set_glyph_attr_pointers(shader, *offset);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, chunk.size());
+      stats.draw_calls++;
+      stats.elements += 4 * chunk.size();
+      stats.instances += chunk.size();
+    }
+    batch.instances.clear();
+  }
+}
@@ -1,23 +1,203 @@
 #pragma once
 
+#include <vector>
+#include <cstddef>
+
+#include <gsl/span>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
+#include "gl_object.hpp"
+#include "gl_texture.hpp"
+#include "stream_buffer.hpp"
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Renderer
 
+/// Counters of GL work issued by the renderer since the last begin_render()
+struct RenderStats {
+  size_t draw_calls = 0;    // glDraw* calls
+  size_t elements = 0;      // indices submitted to draw calls
+  size_t texture_binds = 0; // glBindTexture calls
+  size_t vao_binds = 0;     // glBindVertexArray calls
+  size_t instances = 0;     // instances drawn by instanced draw calls
+  size_t instances_dropped = 0; // instances not drawn as the StreamBuffer had no room for them
+  size_t gl_calls_issued = 0;  // state changing calls that went through GLState to the driver
+  size_t gl_calls_skipped = 0; // state changing calls skipped by GLState as redundant
+  size_t stream_bytes = 0;  // bytes written to the StreamBuffer
+  size_t stream_waits = 0;  // times the StreamBuffer waited on the GPU to reuse a range
+  size_t glyph_uploads = 0; // glyphs rasterized and uploaded by the GlyphCache
+  float resolution_scale = 1.0f; // internal resolution of the scene over the viewport's, per axis
+};
+
+/// Get renderer stats of the current frame of the calling thread, each thread rendering counts its own.
+/// Pass them along with the frame to read them on another thread.
+auto render_stats() -> RenderStats&;
+
 /// Prepare to render
 void begin_render();
 
-/// Render a colored GLObject with indices
+/// Render a colored GLObject with indices, with the GLSub::COLOR variant of the generic shader bound
 void draw_colored_object(const class GLShader& shader, const struct GLObject& glo, const glm::mat4& model);
 
 
-/// Render a textured GLObject with indices
+/// Render count vertices of a colored GLObject from first on as mode primitives (e.g. GL_LINES), without indices,
+/// with the GLSub::COLOR variant of the generic shader bound
+void draw_colored_arrays(const class GLShader& shader, const struct GLObject& glo, GLenum mode, size_t first, size_t count,
+                         const glm::mat4& model);
+
+/// Render a textured GLObject with indices, with the GLSub::TEXTURE variant of the generic shader bound
 void draw_textured_object(const class GLShader& shader, const struct GLTexture& texture, const struct GLObject& glo,
                           const glm::mat4& model, const struct SpriteFrame* sprite = nullptr);
 
 
-/// Render a text GLObject with indices
+/// Render a text GLObject with indices, with the GLSub::FONT variant of the generic shader bound
 void draw_text_object(const class GLShader& shader, const struct GLTexture& texture, const struct GLObject& glo,
                       const glm::mat4& model, const glm::vec4& color, const glm::vec4& outline_color, const float outline_thickness);
 
+/// SpriteBatch accumulates textured quads, transformed on the CPU, and streams them through the StreamBuffer,
+/// drawing each run of consecutive sprites sharing the same shader and texture with a single call.
+/// Submission order is kept, so layering is the same as drawing every sprite on its own.
+class SpriteBatch final {
+  SpriteBatch(GLObject glo, StreamBuffer& stream);
+
+ public:
+  /// Max sprites per draw call, 4 vertices each must be addressable by GLushort indices
+  static constexpr size_t kMaxSprites = 4096;
+
+  // Movable but not Copyable
+  SpriteBatch(SpriteBatch&&) = default;
+  SpriteBatch(const SpriteBatch&) = delete;
+  SpriteBatch& operator=(SpriteBatch&&) = default;
+  SpriteBatch& operator=(const SpriteBatch&) = delete;
+
+  /// Create the quad indices and the shader's textured vertex layout over the stream buffer, which must outlive it.
+  /// Sprites are drawn with textured shaders, like the GLSub::TEXTURE variant of the generic shader.
+  static auto create(const class GLShader& shader, StreamBuffer& stream) -> SpriteBatch;
+
+  /// Queue a unit quad (-1,-1 to +1,+1) transformed by model, sampling texrect (s0, t0, s1, t1) of the texture.
+  /// Flushes first if the shader or texture differ from the queued sprites.
+  void draw(const class GLShader& shader, const struct GLTexture& texture, const glm::mat4& model,
+            const glm::vec4& texrect = kFullTexRect);
+
+  /// Draw all queued sprites with the bound shader.
+  /// Must be called before issuing any other draw call and at the end of the frame.
+  void flush();
+
+ private:
+  GLObject glo_;
+  StreamBuffer* stream_;
+  std::vector<TextureVertex> vertices_;
+  const class GLShader* shader_ = nullptr;
+  const struct GLTexture* texture_ = nullptr;
+};
+
+/// SpriteInstancer draws all sprites sharing a texture with one glDrawArraysInstanced call of a unit quad whose
+/// corners the shader generates from gl_VertexID, so there's no mesh nor index buffer to fetch.
+/// Each instance's affine transform, texture rect and tint are streamed through the StreamBuffer.
+/// Instances are grouped by texture, so only use it for sprites whose relative order within a layer doesn't matter.
+class SpriteInstancer final {
+  SpriteInstancer(GLObject glo, StreamBuffer& stream);
+
+ public:
+  /// Max instances uploaded per stream write, more are drawn in several uploads
+  static constexpr size_t kMaxInstances = 4096;
+  /// Texture groups kept around before pruning unused ones
+  static constexpr size_t kMaxGroups = 32;
+
+  // Movable but not Copyable
+  SpriteInstancer(SpriteInstancer&&) = default;
+  SpriteInstancer(const SpriteInstancer&) = delete;
+  SpriteInstancer& operator=(SpriteInstancer&&) = default;
+  SpriteInstancer& operator=(const SpriteInstancer&) = delete;
+
+  /// Create the instanced sprite shader's instance layout over the stream buffer, which must outlive it
+  static auto create(const class GLShader& shader, StreamBuffer& stream) -> SpriteInstancer;
+
+  /// Queue an instance of the unit quad transformed by model, sampling texrect (s0, t0, s1, t1) of the texture
+  void add(const struct GLTexture& texture, const glm::mat4& model, const glm::vec4& texrect = kFullTexRect,
+           const glm::vec4& tint = glm::vec4(1.0f));
+
+  /// Check if there are no instances queued
+  [[nodiscard]] bool empty() const { return queued_ == 0; }
+
+  /// Draw all queued instances with the bound instanced sprite shader, one draw call per texture
+  void flush(const class GLShader& shader);
+
+ private:
+  /// Instances sharing the same texture
+  struct Group {
+    const struct GLTexture* texture;
+    std::vector<SpriteInstance> instances;
+  };
+
+  /// Run of staged instances sharing a texture, drawn with one call
+  struct Draw {
+    const struct GLTexture* texture;
+    size_t count;
+  };
+
+  /// Upload the staged instances and draw their runs, counting them as dropped when the stream has no room
+  void draw_staged(const class GLShader& shader);
+
+  GLObject glo_; // only the VAO of the instance layout
+  StreamBuffer* stream_;
+  std::vector<Group> groups_;
+  std::vector<SpriteInstance> staging_;
+  std::vector<Draw> draws_;
+  size_t queued_ = 0;
+};
+
+/// TextBatch appends the glyphs of all text sharing a glyph cache page into one batch, placed on the CPU
+/// with each text's color and outline in its instances, and draws each batch with a single instanced call of the
+/// text shader, which generates the glyph quads' corners from gl_VertexID.
+/// Glyphs are looked up in the GlyphCache as they're added, so layouts never hold stale texture coordinates.
+/// Bitmap and SDF fonts are both supported, the shader is told which one each batch samples.
+/// Batches are drawn in order of first use, so only use it for text whose relative order within a layer doesn't matter.
+class TextBatch final {
+  TextBatch(GLObject glo, StreamBuffer& stream, class GlyphCache& cache);
+
+ public:
+  /// Max glyphs per draw call
+  static constexpr size_t kMaxGlyphs = 4096;
+  /// Page batches kept around before pruning unused ones
+  static constexpr size_t kMaxBatches = 8;
+
+  // Movable but not Copyable
+  TextBatch(TextBatch&&) = default;
+  TextBatch(const TextBatch&) = delete;
+  TextBatch& operator=(TextBatch&&) = default;
+  TextBatch& operator=(const TextBatch&) = delete;
+
+  /// Create the text shader's glyph instance layout over the stream buffer.
+  /// The stream buffer and glyph cache must outlive it.
+  static auto create(const class GLShader& shader, StreamBuffer& stream, class GlyphCache& cache) -> TextBatch;
+
+  /// Queue the glyphs of a layout, as given by layout_text() for the font, transformed by model.
+  /// Outline thickness is in font texels, limited to the spread of SDF fonts.
+  void add(const struct GLFont& font, const struct GlyphLayout& layout, const glm::mat4& model,
+           const glm::vec4& color, const glm::vec4& outline_color, float outline_thickness);
+
+  /// Check if there are no glyphs queued
+  [[nodiscard]] bool empty() const { return queued_ == 0; }
+
+  /// Draw all queued glyphs with the bound text shader, one draw call per glyph cache page and font kind
+  void flush(const class GLShader& shader);
+
+ private:
+  /// Glyphs sharing the same glyph cache page and SDF spread
+  struct Batch {
+    const struct GLTexture* page;
+    float sdf_spread;
+    std::vector<GlyphInstance> instances;
+  };
+
+  /// Get the batch of glyphs in the page with the SDF spread, adding it if new
+  auto find_batch(const struct GLTexture& page, float sdf_spread) -> Batch&;
+
+  GLObject glo_;
+  StreamBuffer* stream_;
+  class GlyphCache* cache_;
+  std::vector<Batch> batches_;
+  size_t queued_ = 0;
+};
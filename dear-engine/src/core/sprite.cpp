@@ -22,20 +22,39 @@ void SpriteAnimation::update_frame(float dt) {
 ///       |  1  |  2  |  3  |
 ///       |     |     |     |
 /// (0,0) +-----+-----+-----+ (1,0)
-auto gen_sprite_quads(size_t count) -> std::tuple<std::vector<TextureVertex>, std::vector<GLushort>>
+auto gen_sprite_quads(size_t count) -> std::tuple<std::vector<PackedTextureVertex>, std::vector<GLushort>>
 {
   float width = 1.0f / count;
-  std::vector<TextureVertex> vertices;
+  std::vector<PackedTextureVertex> vertices;
   std::vector<GLushort> indices;
   vertices.reserve(4 * count);
   indices.reserve(6 * count);
   for (size_t i = 0; i < count; i++) {
-    vertices.emplace_back(TextureVertex{ .pos = { +1.0f, +1.0f }, .texcoord = { (i+1)*width, 1.0f } });
-    vertices.emplace_back(TextureVertex{ .pos = { +1.0f, -1.0f }, .texcoord = { (i+1)*width, 0.0f } });
-    vertices.emplace_back(TextureVertex{ .pos = { -1.0f, -1.0f }, .texcoord = { (i+0)*width, 0.0f } });
-    vertices.emplace_back(TextureVertex{ .pos = { -1.0f, +1.0f }, .texcoord = { (i+0)*width, 1.0f } });
+    const glm::u16vec4 t = pack_texrect({ (i+0)*width, 0.0f, (i+1)*width, 1.0f });
+    vertices.emplace_back(PackedTextureVertex{ .pos = pack_unit_position({ +1.0f, +1.0f }), .texcoord = { t[2], t[3] } });
+    vertices.emplace_back(PackedTextureVertex{ .pos = pack_unit_position({ +1.0f, -1.0f }), .texcoord = { t[2], t[1] } });
+    vertices.emplace_back(PackedTextureVertex{ .pos = pack_unit_position({ -1.0f, -1.0f }), .texcoord = { t[0], t[1] } });
+    vertices.emplace_back(PackedTextureVertex{ .pos = pack_unit_position({ -1.0f, +1.0f }), .texcoord = { t[0], t[3] } });
     for (auto v : kQuadIndices)
       indices.emplace_back(4*i+v);
   }
   return {vertices, indices};
 }
+
+/// Generate the frames for a spritesheet laid out linearly as in gen_sprite_quads(count),
+/// all with the same duration, referencing both the quads' indices and their texture rect.
+auto gen_sprite_frames(size_t count, float duration) -> std::vector<SpriteFrame>
+{
+  float width = 1.0f / count;
+  std::vector<SpriteFrame> frames;
+  frames.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    frames.emplace_back(SpriteFrame{
+      .duration = duration,
+      .ebo_offset = i * std::size(kQuadIndices) * sizeof(GLushort),
+      .ebo_count = std::size(kQuadIndices),
+      .texrect = { (i+0)*width, 0.0f, (i+1)*width, 1.0f },
+    });
+  }
+  return frames;
+}
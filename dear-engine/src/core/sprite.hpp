@@ -2,6 +2,7 @@
 
 #include <glbinding/gl33core/types.h>
 using namespace gl;
+#include <glm/vec4.hpp>
 
 #include "gl_object.hpp"
 
@@ -13,6 +14,7 @@ struct SpriteFrame {
   float duration;    // duration in seconds, negative is infinite
   size_t ebo_offset; // offset to the first index of this frame in the EBO
   size_t ebo_count;  // number of elements to render since first index
+  glm::vec4 texrect; // texture coordinates rect (s0, t0, s1, t1) of this frame in the spritesheet
 };
 
 /// Control data required for a single Sprite Animation object
@@ -40,4 +42,8 @@ struct SpriteAnimation {
 ///       |  1  |  2  |  3  |
 ///       |     |     |     |
 /// (0,0) +-----+-----+-----+ (1,0)
-auto gen_sprite_quads(size_t count) -> std::tuple<std::vector<TextureVertex>, std::vector<GLushort>>;
+auto gen_sprite_quads(size_t count) -> std::tuple<std::vector<PackedTextureVertex>, std::vector<GLushort>>;
+
+/// Generate the frames for a spritesheet laid out linearly as in gen_sprite_quads(count),
+/// all with the same duration, referencing both the quads' indices and their texture rect.
+auto gen_sprite_frames(size_t count, float duration) -> std::vector<SpriteFrame>;
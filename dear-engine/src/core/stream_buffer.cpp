@@ -0,0 +1,112 @@
+#include "stream_buffer.hpp"
+
+#include <cstring>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+
+#include "log.hpp"
+#include "renderer.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Stream Buffer
+
+/// Max time to wait on a fence per glClientWaitSync call, waits are retried until the fence is signaled
+static constexpr GLuint64 kFenceTimeoutNs = 1'000'000'000;
+
+StreamBuffer::StreamBuffer(GLuint vbo, size_t capacity)
+    : vbo_(vbo), capacity_(capacity)
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+  for (Fence& fence : fences_)
+    glDeleteSync(fence.sync);
+  if (vbo_) glDeleteBuffers(1, &vbo_.inner);
+}
+
+/// Create the ring buffer storage
+auto StreamBuffer::create(size_t capacity) -> StreamBuffer
+{
+  GLuint vbo;
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+  return StreamBuffer(vbo, capacity);
+}
+
+/// Copy size bytes to a new range of the ring aligned to align bytes
+auto StreamBuffer::write(const void* data, size_t size, size_t align) -> std::optional<size_t>
+{
+  if (size == 0) return 0;
+  if (size > capacity_) {
+    ERROR("Stream buffer write of {} bytes exceeds its capacity of {} bytes", size, capacity_);
+    return std::nullopt;
+  }
+  // Offsets must be a multiple of the element size to be addressed by base vertex, which needn't be a power of 2
+  size_t offset = (head_ + align - 1) / align * align;
+  size_t padding = offset - head_;
+  if (offset + size > capacity_) { // wrap around, skipping the tail end
+    offset = 0;
+    padding = capacity_ - head_;
+  }
+  const size_t needed = padding + size;
+  while (capacity_ - used_ < needed) {
+    if (!retire_oldest()) {
+      ERROR("Stream buffer ran out of its {} bytes within a single frame", capacity_);
+      return std::nullopt;
+    }
+  }
+  used_ += needed;
+  frame_bytes_ += needed;
+  head_ = offset + size;
+
+  // Fenced ranges are never touched, so there's nothing for the driver to synchronize
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  void* dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if (!dst) {
+    ERROR("Failed to map stream buffer range ({}, {})", offset, size);
+    return std::nullopt;
+  }
+  std::memcpy(dst, data, size);
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  render_stats().stream_bytes += size;
+  return offset;
+}
+
+/// Fence the ranges written since the last call
+void StreamBuffer::end_frame()
+{
+  if (frame_bytes_ == 0) return;
+  fences_.push_back(Fence{ .sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT), .bytes = frame_bytes_ });
+  frame_bytes_ = 0;
+  // Release frames the GPU is already done with, so fences don't pile up while the ring has room
+  while (!fences_.empty()) {
+    const GLenum status = glClientWaitSync(fences_.front().sync, SyncObjectMask{}, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+    glDeleteSync(fences_.front().sync);
+    used_ -= fences_.front().bytes;
+    fences_.pop_front();
+  }
+}
+
+/// Wait for the oldest fenced frame to be done on the GPU and release its bytes
+bool StreamBuffer::retire_oldest()
+{
+  if (fences_.empty()) return false;
+  Fence fence = fences_.front();
+  fences_.pop_front();
+  GLenum status = glClientWaitSync(fence.sync, SyncObjectMask{}, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    render_stats().stream_waits++;
+    do status = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeoutNs);
+    while (status == GL_TIMEOUT_EXPIRED);
+  }
+  if (status == GL_WAIT_FAILED)
+    ERROR("Failed to wait on stream buffer fence");
+  glDeleteSync(fence.sync);
+  used_ -= fence.bytes;
+  return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <deque>
+#include <cstddef>
+#include <optional>
+
+#include <gsl/span>
+#include <glbinding/gl33core/types.h>
+using namespace gl;
+
+#include "unique_num.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Stream Buffer
+
+/// StreamBuffer is one large vertex buffer used as a ring, from which per-frame geometry is sub-allocated.
+/// Ranges are written through glMapBufferRange with GL_MAP_UNSYNCHRONIZED_BIT, so the driver never stalls
+/// or orphans storage; instead each frame's ranges are guarded by a fence placed at end_frame(), and the ring
+/// only waits on it when it wraps around to storage the GPU may still be reading.
+/// Being a single buffer object, it's bound once and draws select their data by offset or base vertex.
+class StreamBuffer final {
+  StreamBuffer(GLuint vbo, size_t capacity);
+
+ public:
+  /// Default ring size, room for a few frames of sprites, text and debug geometry
+  static constexpr size_t kDefaultCapacity = 8 << 20;
+
+  ~StreamBuffer();
+
+  // Movable but not Copyable
+  StreamBuffer(StreamBuffer&&) = default;
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(StreamBuffer&&) = default;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  /// Create the ring buffer storage
+  static auto create(size_t capacity = kDefaultCapacity) -> StreamBuffer;
+
+  /// Buffer object name, to set up vertex attributes sourcing from the ring
+  [[nodiscard]] GLuint id() const { return vbo_; }
+
+  /// Copy data to a new range of the ring, aligned to the element size, and leave the buffer bound to GL_ARRAY_BUFFER.
+  /// Returns the byte offset of the range, which divided by sizeof(T) is the base vertex (or instance) of the data.
+  /// Returns nullopt when the data doesn't fit in the whole ring.
+  template<typename T>
+  auto write(gsl::span<const T> data) -> std::optional<size_t> {
+    return write(data.data(), data.size_bytes(), sizeof(T));
+  }
+
+  /// Copy size bytes to a new range of the ring aligned to align bytes, see the typed overload
+  auto write(const void* data, size_t size, size_t align) -> std::optional<size_t>;
+
+  /// Fence the ranges written since the last call, must be called once all draws of the frame were issued
+  void end_frame();
+
+ private:
+  /// Fence guarding the ranges written during one frame
+  struct Fence {
+    GLsync sync;
+    size_t bytes; // ring bytes used by the frame, including alignment and wrap-around padding
+  };
+
+  /// Wait for the oldest fenced frame to be done on the GPU and release its bytes, false if none is pending
+  bool retire_oldest();
+
+ private:
+  UniqueNum<GLuint> vbo_;
+  size_t capacity_;
+  size_t head_ = 0;        // offset where the next range starts
+  size_t used_ = 0;        // bytes in use, written but not yet retired
+  size_t frame_bytes_ = 0; // bytes used since the last fence
+  std::deque<Fence> fences_;
+};
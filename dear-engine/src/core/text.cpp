@@ -1,57 +1,270 @@
 #include "./text.hpp"
 
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
 #include <string_view>
 
-#include <glbinding/gl33core/types.h>
-using namespace gl;
+#include <stb/stb_truetype.h>
 
+#include "log.hpp"
 #include "gl_font.hpp"
-#include "gl_object.hpp"
-
-/// Generate quad vertices for a text with the given font.
-auto gen_text_quads(const GLFont& font, std::string_view text) -> std::tuple<std::vector<TextureVertex>, std::vector<GLushort>, float>
-{
-  std::vector<TextureVertex> vertices;
-  vertices.reserve(4 * text.size());
-  std::vector<GLushort> indices;
-  indices.reserve(6 * text.size());
-  float x = 0, y = 0;
-  float width = 0;
-  size_t i = 0;
-  for (char ch : text) {
-    if (ch < font.char_beg || ch > (font.char_beg + font.char_count))
+
+/// Decode the next codepoint of a UTF-8 string, advancing pos past it. Malformed bytes decode as U+FFFD.
+static auto next_codepoint(std::string_view text, size_t& pos) -> char32_t
+{
+  constexpr char32_t kReplacement = 0xFFFD;
+  const auto lead = (unsigned char)text[pos++];
+  if (lead < 0x80) return lead;
+  size_t extra;
+  char32_t cp;
+  if ((lead & 0xE0) == 0xC0)      { extra = 1; cp = lead & 0x1F; }
+  else if ((lead & 0xF0) == 0xE0) { extra = 2; cp = lead & 0x0F; }
+  else if ((lead & 0xF8) == 0xF0) { extra = 3; cp = lead & 0x07; }
+  else return kReplacement;
+  for (size_t i = 0; i < extra; i++) {
+    if (pos >= text.size() || ((unsigned char)text[pos] & 0xC0) != 0x80) return kReplacement;
+    cp = (cp << 6) | ((unsigned char)text[pos++] & 0x3F);
+  }
+  return cp;
+}
+
+/// Lay out a UTF-8 string with the font, applying advances and kerning, breaking lines at '\n' and wrapping
+auto layout_text(const GLFont& font, std::string_view text, const TextLayoutOptions& options) -> GlyphLayout
+{
+  /// Range of glyphs in a line and its width without trailing spaces
+  struct Line {
+    size_t begin;
+    size_t end;
+    float width;
+  };
+  constexpr size_t kNoBreak = SIZE_MAX;
+
+  GlyphLayout layout{ .glyphs = {}, .width = 0.0f, .height = 0.0f, .lines = 0 };
+  layout.glyphs.reserve(text.size());
+  std::vector<Line> lines;
+  size_t line_begin = 0;
+  float line_width = 0.0f; // pen x after the last glyph that isn't a space
+  float x = 0.0f;
+  int prev = 0;
+  size_t break_at = kNoBreak; // first glyph after the last space, where the line can wrap
+  float break_x = 0.0f;
+  float break_width = 0.0f;   // line width if wrapped at break_at
+  const auto end_line = [&](size_t end, float width) {
+    lines.push_back(Line{ .begin = line_begin, .end = end, .width = width });
+    line_begin = end;
+  };
+
+  for (size_t pos = 0; pos < text.size();) {
+    const char32_t cp = next_codepoint(text, pos);
+    if (cp == '\n') {
+      end_line(layout.glyphs.size(), line_width);
+      x = line_width = 0.0f;
+      prev = 0;
+      break_at = kNoBreak;
       continue;
-    stbtt_aligned_quad q;
-    stbtt_GetPackedQuad(font.chars.data(), font.bitmap_px_width, font.bitmap_px_height, (int)ch - font.char_beg, &x, &y, &q, 1);
-    vertices.emplace_back(TextureVertex{ .pos = { q.x0, q.y0 }, .texcoord = { q.s0, q.t0 } });
-    vertices.emplace_back(TextureVertex{ .pos = { q.x1, q.y0 }, .texcoord = { q.s1, q.t0 } });
-    vertices.emplace_back(TextureVertex{ .pos = { q.x1, q.y1 }, .texcoord = { q.s1, q.t1 } });
-    vertices.emplace_back(TextureVertex{ .pos = { q.x0, q.y1 }, .texcoord = { q.s0, q.t1 } });
-    for (auto v : kQuadIndices)
-      indices.emplace_back(4*i+v);
-    width = q.x1;
-    i++;
-  }
-  return std::tuple{vertices, indices, width};
-}
-
-/// Update GLObject data with the new generated quads for the given Text
-void update_text_globject(const GLShader& shader, GLObject& glo, const GLFont& font, std::string_view text, GLenum usage)
-{
-  auto [vertices, indices, _] = gen_text_quads(font, text);
-  if (vertices.size() == glo.num_vertices && indices.size() == glo.num_indices) {
-    glBindVertexArray(glo.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, glo.vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(TextureVertex), vertices.data());
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glo.ebo);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLushort), indices.data());
+    }
+    if (cp < ' ') continue; // other control characters
+    const int glyph = stbtt_FindGlyphIndex(&font.info, (int)cp);
+    int advance, lsb;
+    stbtt_GetGlyphHMetrics(&font.info, glyph, &advance, &lsb);
+    const float glyph_advance = font.scale * advance;
+    if (prev) x += font.scale * stbtt_GetGlyphKernAdvance(&font.info, prev, glyph);
+    prev = glyph;
+    if (cp == ' ') {
+      layout.glyphs.push_back(GlyphLayout::Glyph{ .index = glyph, .x = x, .y = 0.0f });
+      x += glyph_advance;
+      break_at = layout.glyphs.size();
+      break_x = x;
+      break_width = line_width;
+      continue;
+    }
+    // Move the word being laid out to a new line once it overflows, words wider than a line overflow it
+    if (options.wrap_width > 0.0f && x + glyph_advance > options.wrap_width && break_at != kNoBreak && break_at > line_begin) {
+      end_line(break_at, break_width);
+      for (size_t i = break_at; i < layout.glyphs.size(); i++)
+        layout.glyphs[i].x -= break_x;
+      x -= break_x;
+      break_at = kNoBreak;
+    }
+    layout.glyphs.push_back(GlyphLayout::Glyph{ .index = glyph, .x = x, .y = 0.0f });
+    x += glyph_advance;
+    line_width = x;
+  }
+  end_line(layout.glyphs.size(), line_width);
+
+  int ascent, descent, line_gap;
+  stbtt_GetFontVMetrics(&font.info, &ascent, &descent, &line_gap);
+  const float line_height = font.scale * (ascent - descent + line_gap) * options.line_spacing;
+  if (options.wrap_width > 0.0f) {
+    layout.width = options.wrap_width;
   } else {
-    glo = create_text_globject(shader, vertices, indices, usage);
+    for (const Line& line : lines)
+      layout.width = std::max(layout.width, line.width);
+  }
+  for (size_t i = 0; i < lines.size(); i++) {
+    const Line& line = lines[i];
+    float offset = 0.0f;
+    if (options.align == TextAlign::CENTER) offset = (layout.width - line.width) / 2.0f;
+    else if (options.align == TextAlign::RIGHT) offset = layout.width - line.width;
+    for (size_t g = line.begin; g < line.end; g++) {
+      layout.glyphs[g].x += offset;
+      layout.glyphs[g].y = line_height * i;
+    }
+  }
+  layout.lines = lines.size();
+  layout.height = line_height * (lines.size() - 1);
+  return layout;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Text Layout Cache
+
+/// Check if options lay out text the same way
+static bool same_options(const TextLayoutOptions& a, const TextLayoutOptions& b)
+{
+  return a.wrap_width == b.wrap_width && a.align == b.align && a.line_spacing == b.line_spacing;
+}
+
+/// Hash a layout's font, options and string
+static auto hash_layout(uint32_t font, std::string_view text, const TextLayoutOptions& options) -> uint64_t
+{
+  uint64_t hash = std::hash<std::string_view>{}(text);
+  const auto combine = [&](uint64_t value) { hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+  uint32_t bits;
+  combine(font);
+  std::memcpy(&bits, &options.wrap_width, sizeof(bits));
+  combine(bits);
+  combine((uint64_t)options.align);
+  std::memcpy(&bits, &options.line_spacing, sizeof(bits));
+  combine(bits);
+  return hash;
+}
+
+/// Get the layout of a string with the font, laying it out if not cached
+auto TextLayoutCache::get(const GLFont& font, std::string_view text, const TextLayoutOptions& options) -> GlyphLayoutRef
+{
+  const uint64_t hash = hash_layout(font.id, text, options);
+  if (auto it = index_.find(hash); it != index_.end()) {
+    const auto entry = it->second;
+    if (entry->font == font.id && entry->text == text && same_options(entry->options, options)) {
+      entries_.splice(entries_.begin(), entries_, entry);
+      return entry->layout;
+    }
+    // Hash collision, the new layout takes its place
+    entries_.erase(entry);
+    index_.erase(it);
+  }
+  auto layout = std::make_shared<const GlyphLayout>(layout_text(font, text, options));
+  entries_.push_front(Entry{ .hash = hash, .font = font.id, .options = options, .text = std::string(text), .layout = layout });
+  index_.emplace(hash, entries_.begin());
+  if (entries_.size() > max_entries_) {
+    index_.erase(entries_.back().hash);
+    entries_.pop_back();
+  }
+  return layout;
+}
+
+/// Get the text layout cache of the calling thread
+auto text_layout_cache() -> TextLayoutCache&
+{
+  // Per thread, text is laid out by both the game and render threads
+  thread_local TextLayoutCache cache;
+  return cache;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Glyph Run
+
+/// Set the string laid out with the font, returns true if it changed and its layout was replaced
+bool GlyphRun::set(const GLFont& font, std::string_view text, const TextLayoutOptions& options)
+{
+  if (layout_ && &font == font_ && text == text_ && same_options(options, options_)) return false;
+  // Shared immutable layouts, previous ones may still be referenced by frames in flight
+  layout_ = text_layout_cache().get(font, text, options);
+  text_ = text;
+  font_ = &font;
+  options_ = options;
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Numeric Text
+
+/// Lay out an ASCII format of label text and numeric fields with the font
+auto NumericText::create(const GLFont& font, std::string_view format) -> NumericText
+{
+  const auto is_field_char = [](char ch) { return ch == '#' || ch == '0' || ch == '.'; };
+  NumericText text;
+  std::string filled(format); // slots shown as '0' to lay out with its advance
+  for (size_t i = 0; i < format.size();) {
+    const char ch = format[i];
+    ASSERT_MSG((unsigned char)ch >= ' ' && (unsigned char)ch < 0x80, "NumericText format must be printable ASCII: '{}'", format);
+    if (!is_field_char(ch) || ch == '.') { i++; continue; }
+    Field field{ .begin = text.slots_.size(), .end = 0, .decimals = 0 };
+    bool decimal = false;
+    for (; i < format.size() && is_field_char(format[i]); i++) {
+      if (format[i] == '.') {
+        ASSERT_MSG(!decimal, "NumericText field with two decimal points: '{}'", format);
+        decimal = true;
+        continue;
+      }
+      text.slots_.push_back(Slot{ .glyph = i, .x = 0.0f, .zero_pad = format[i] == '0' });
+      filled[i] = '0';
+      if (decimal) field.decimals++;
+    }
+    field.end = text.slots_.size();
+    ASSERT_MSG(field.end - field.begin <= kMaxFieldDigits, "NumericText field over {} digits: '{}'", kMaxFieldDigits, format);
+    text.fields_.push_back(field);
+  }
+
+  // Printable ASCII lays out one glyph per character, so slots index the layout by their character
+  text.layout_ = layout_text(font, filled);
+  for (Slot& slot : text.slots_)
+    slot.x = text.layout_.glyphs[slot.glyph].x;
+  int zero_advance, lsb;
+  stbtt_GetGlyphHMetrics(&font.info, stbtt_FindGlyphIndex(&font.info, '0'), &zero_advance, &lsb);
+  for (int digit = 0; digit < 10; digit++) {
+    const int glyph = stbtt_FindGlyphIndex(&font.info, '0' + digit);
+    int advance;
+    stbtt_GetGlyphHMetrics(&font.info, glyph, &advance, &lsb);
+    text.digit_glyphs_[digit] = glyph;
+    text.digit_offsets_[digit] = font.scale * (zero_advance - advance) / 2.0f;
   }
+  text.blank_glyph_ = stbtt_FindGlyphIndex(&font.info, ' ');
+  for (size_t field = 0; field < text.fields_.size(); field++)
+    text.set(field, 0.0);
+  return text;
 }
 
-/// Upload new Text Indexed-Vertex object to GPU memory
-auto create_text_globject(const GLShader& shader, gsl::span<const TextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage) -> GLObject
+/// Set the value of a field, rewriting only its changed digits
+void NumericText::set(size_t field, double value)
 {
-  return create_textured_globject(shader, vertices, indices, usage);
+  ASSERT_MSG(field < fields_.size(), "NumericText has no field {}", field);
+  const Field& f = fields_[field];
+  const size_t count = f.end - f.begin;
+  const size_t integer_slots = count - f.decimals;
+  double scale = 1.0, limit = 1.0;
+  for (size_t i = 0; i < count; i++) {
+    limit *= 10.0;
+    if (i < f.decimals) scale *= 10.0;
+  }
+  const double scaled = std::round(value * scale);
+  // NaN fails both comparisons and casting it is undefined, show it as 0
+  uint64_t digits = std::isnan(scaled) || scaled <= 0.0 ? 0 : scaled >= limit - 1.0 ? (uint64_t)(limit - 1.0) : (uint64_t)scaled;
+  // From the least significant slot, so the digits left tell if a slot is a leading zero
+  for (size_t i = count; i-- > 0;) {
+    Slot& slot = slots_[f.begin + i];
+    const int digit = digits % 10;
+    digits /= 10;
+    const bool leading = i + 1 < integer_slots && digit == 0 && digits == 0;
+    const int shown = leading && !slot.zero_pad ? -1 : digit;
+    if (shown == slot.digit) continue;
+    slot.digit = shown;
+    version_++;
+    GlyphLayout::Glyph& glyph = layout_.glyphs[slot.glyph];
+    glyph.index = shown < 0 ? blank_glyph_ : digit_glyphs_[shown];
+    glyph.x = shown < 0 ? slot.x : slot.x + digit_offsets_[shown];
+  }
 }
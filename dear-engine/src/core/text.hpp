@@ -1,23 +1,169 @@
 #pragma once
 
+#include <list>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
 #include <string_view>
+#include <unordered_map>
 
-#include <glbinding/gl33core/types.h>
-using namespace gl;
-
+#include "aabb.hpp"
 #include "gl_font.hpp"
-#include "gl_object.hpp"
-#include "gl_shader.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Text
 
-/// Generate quad vertices for a text with the given font.
-auto gen_text_quads(const GLFont& font, std::string_view text) -> std::tuple<std::vector<TextureVertex>, std::vector<GLushort>, float>;
+/// Horizontal alignment of the lines of a text
+enum class TextAlign : uint8_t {
+  LEFT,
+  CENTER,
+  RIGHT,
+};
+
+/// How to lay out a text
+struct TextLayoutOptions {
+  float wrap_width = 0.0f;           // in font pixels, lines are broken between words to fit it, zero doesn't wrap
+  TextAlign align = TextAlign::LEFT; // within wrap_width if set, otherwise within the widest line
+  float line_spacing = 1.0f;         // factor of the font's line height
+};
+
+/// Glyphs of a laid out string, positioned in font pixel units with the first baseline at y 0 and y going down
+struct GlyphLayout {
+  /// Glyph index in the font and its pen position
+  struct Glyph {
+    int index;
+    float x;
+    float y;
+  };
+  std::vector<Glyph> glyphs;
+  float width;  // widest line, or wrap_width if set
+  float height; // distance from the first baseline to the last one
+  size_t lines;
+
+  /// Box around the glyphs in font pixels, padded by line_height above the first baseline and below the last one
+  [[nodiscard]] Aabb bounds(float line_height) const {
+    return Aabb{ .min = { 0.0f, -line_height }, .max = { width, height + line_height } };
+  }
+};
+
+/// GlyphLayout reference type alias, immutable so frames in flight can keep drawing it while the run changes
+using GlyphLayoutRef = std::shared_ptr<const GlyphLayout>;
+
+/// Lay out a UTF-8 string with the font, applying advances and kerning, breaking lines at '\n' and wrapping.
+/// Codepoints are mapped to glyph indices, which the GlyphCache rasterizes when the layout is drawn.
+auto layout_text(const GLFont& font, std::string_view text, const TextLayoutOptions& options = {}) -> GlyphLayout;
+
+/// TextLayoutCache memoizes text layouts by font, options and string, evicting the least recently used ones.
+/// Layouts are sized in font pixels and scaled when drawn, so one layout serves every text size of a font.
+class TextLayoutCache final {
+ public:
+  /// Default number of layouts kept
+  static constexpr size_t kMaxEntries = 256;
+
+  explicit TextLayoutCache(size_t max_entries = kMaxEntries) : max_entries_(max_entries) {}
+
+  // Movable but not Copyable
+  TextLayoutCache(TextLayoutCache&&) = default;
+  TextLayoutCache(const TextLayoutCache&) = delete;
+  TextLayoutCache& operator=(TextLayoutCache&&) = default;
+  TextLayoutCache& operator=(const TextLayoutCache&) = delete;
+
+  /// Get the layout of a string with the font, laying it out if not cached
+  auto get(const GLFont& font, std::string_view text, const TextLayoutOptions& options = {}) -> GlyphLayoutRef;
+
+  /// Number of layouts cached
+  [[nodiscard]] size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    uint32_t font;
+    TextLayoutOptions options;
+    std::string text;
+    GlyphLayoutRef layout;
+  };
+
+  std::list<Entry> entries_; // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_; // by hash of font, options and string
+  size_t max_entries_;
+};
+
+/// Get the text layout cache of the calling thread
+auto text_layout_cache() -> TextLayoutCache&;
+
+/// GlyphRun retains the glyph layout of a string, getting it again from the thread's TextLayoutCache only when the string changes.
+/// Runs are drawn through the TextBatch, which resolves their glyphs in the GlyphCache every frame,
+/// so a layout stays valid when glyph cache pages are evicted.
+class GlyphRun final {
+ public:
+  /// Set the string laid out with the font, returns true if it changed and its layout was replaced
+  bool set(const GLFont& font, std::string_view text, const TextLayoutOptions& options = {});
+
+  /// Get the current string
+  [[nodiscard]] std::string_view text() const { return text_; }
+
+  /// Get the current glyph layout, null until a string is set
+  [[nodiscard]] const GlyphLayoutRef& layout() const { return layout_; }
+
+ private:
+  std::string text_;
+  const GLFont* font_ = nullptr;
+  TextLayoutOptions options_;
+  GlyphLayoutRef layout_;
+};
+
+/// NumericText lays out a format of label text and digit slots once, then shows numbers in it by replacing
+/// the glyphs of changed digits in place: no formatting, layout or allocation per update, for counters and HUD values.
+/// Digits are centered in slots as wide as '0', so values don't jiggle with proportional digits.
+/// Its layout is mutable, so draw it within the frame it's updated, like the render thread's HUD.
+class NumericText final {
+ public:
+  /// Max digit slots of a field, so its values fit in 64 bits
+  static constexpr size_t kMaxFieldDigits = 18;
+
+  NumericText() = default;
+
+  /// Lay out an ASCII format with the font. Runs of '#', '0' and '.' are fields, numbered left to right:
+  /// a '0' slot shows leading zeros, a leading '#' slot is blank and slots after the '.' are decimals.
+  /// E.g. "FPS ##0 ms ##0.000" has two fields. All fields start at zero.
+  static auto create(const GLFont& font, std::string_view format) -> NumericText;
+
+  /// Set the value of a field, rewriting only its changed digits.
+  /// Values are rounded to the field's decimals and clamped to what its slots can show, NaN shows as 0.
+  void set(size_t field, double value);
+
+  /// Get the glyph layout with the current values
+  [[nodiscard]] const GlyphLayout& layout() const { return layout_; }
+
+  /// Number of fields in the format
+  [[nodiscard]] size_t num_fields() const { return fields_.size(); }
+
+  /// Number of times the layout changed, to tell when something drawn from it is stale
+  [[nodiscard]] uint64_t version() const { return version_; }
 
-/// Update GLObject data with the new generated quads for the given Text
-void update_text_globject(const GLShader& shader, GLObject& glo, const GLFont& font, std::string_view text, GLenum usage = GL_STATIC_DRAW);
+ private:
+  /// Glyph of the layout showing a digit
+  struct Slot {
+    size_t glyph;   // index in layout_.glyphs
+    float x;        // pen position of the slot
+    bool zero_pad;  // shows leading zeros
+    int digit = 0;  // digit shown, -1 when blank
+  };
 
-/// Upload new Text Indexed-Vertex object to GPU memory
-auto create_text_globject(const GLShader& shader, gsl::span<const TextureVertex> vertices, gsl::span<const GLushort> indices, GLenum usage) -> GLObject;
+  /// Range of slots of a number
+  struct Field {
+    size_t begin;
+    size_t end;
+    size_t decimals;
+  };
 
+  GlyphLayout layout_;
+  std::vector<Slot> slots_;
+  std::vector<Field> fields_;
+  std::array<int, 10> digit_glyphs_;     // glyph index of each digit
+  std::array<float, 10> digit_offsets_;  // x offset centering each digit in a slot
+  int blank_glyph_ = 0;
+  uint64_t version_ = 0;
+};
@@ -0,0 +1,147 @@
+#include "texture_atlas.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <algorithm>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+
+#include <stb/stb_image.h>
+#include <stb/stb_rect_pack.h>
+
+#include "log.hpp"
+#include "file.hpp"
+#include "gl_state.hpp"
+
+using namespace std::string_literals;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Texture Atlas
+
+/// Decoded RGBA image waiting to be packed
+struct AtlasImage {
+  int width;
+  int height;
+  std::unique_ptr<uint8_t[], void(*)(void*)> pixels;
+};
+
+/// Mipmap levels that don't mix neighbour images, given images are aligned to kAtlasPadding
+static constexpr int atlas_max_level()
+{
+  int level = 0;
+  while ((2 << level) <= kAtlasPadding) level++;
+  return level;
+}
+
+/// Round size up to a multiple of kAtlasPadding, so packed positions are aligned to it too
+static int atlas_align(int size)
+{
+  return (size + kAtlasPadding - 1) / kAtlasPadding * kAtlasPadding;
+}
+
+/// Copy image into the page at the packed cell, extruding its edge pixels over the rest of the cell
+static void blit_extruded(uint8_t* page, int page_width, const AtlasImage& image, const stbrp_rect& cell)
+{
+  for (int cy = 0; cy < cell.h; cy++) {
+    const int sy = std::clamp(cy - kAtlasPadding, 0, image.height - 1);
+    uint8_t* dst_row = page + ((cell.y + cy) * page_width + cell.x) * 4;
+    const uint8_t* src_row = image.pixels.get() + sy * image.width * 4;
+    for (int cx = 0; cx < cell.w; cx++) {
+      const int sx = std::clamp(cx - kAtlasPadding, 0, image.width - 1);
+      std::memcpy(dst_row + cx * 4, src_row + sx * 4, 4);
+    }
+  }
+}
+
+/// Upload RGBA atlas page to GPU memory
+static auto load_atlas_page_texture(const uint8_t data[], int width, int height, GLenum min_filter, GLenum mag_filter) -> GLTexture
+{
+  GLuint texture;
+  glGenTextures(1, &texture);
+  gl_state().bind_texture(0, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter != GLenum(0) ? mag_filter : min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, atlas_max_level());
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  return GLTexture{ texture };
+}
+
+/// Read the image files and pack them into as few RGBA texture pages as possible, uploading them to GPU memory.
+/// Returns the region of each image in the same order as the input paths, images on the same page share its GLTextureRef.
+auto pack_texture_atlas(const std::vector<std::string>& inpaths, GLenum min_filter, GLenum mag_filter)
+    -> std::optional<std::vector<TextureRegion>>
+{
+  GLint max_texture_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+  const int page_size = std::min(kAtlasPageSize, max_texture_size);
+
+  std::vector<AtlasImage> images;
+  std::vector<stbrp_rect> pending;
+  images.reserve(inpaths.size());
+  pending.reserve(inpaths.size());
+  stbi_set_flip_vertically_on_load(true);
+  for (const std::string& inpath : inpaths) {
+    const std::string filepath = ENGINE_ASSETS_PATH + "/"s + inpath;
+    auto file = read_file_to_string(filepath);
+    if (!file) { ERROR("Failed to read texture path ({})", filepath); return std::nullopt; }
+    int width, height, channels;
+    uint8_t* data = stbi_load_from_memory((const uint8_t*)file->data(), file->length(), &width, &height, &channels, 4);
+    if (!data) { ERROR("Failed to load texture path ({})", filepath); return std::nullopt; }
+    images.emplace_back(AtlasImage{ width, height, { data, stbi_image_free } });
+    stbrp_rect rect{};
+    rect.id = pending.size();
+    rect.w = atlas_align(width + 2 * kAtlasPadding);
+    rect.h = atlas_align(height + 2 * kAtlasPadding);
+    if (rect.w > page_size || rect.h > page_size) {
+      ERROR("Texture too big for atlas page of {}px ({}, {}x{})", page_size, filepath, width, height);
+      return std::nullopt;
+    }
+    pending.push_back(rect);
+  }
+
+  std::vector<TextureRegion> regions(images.size());
+  std::vector<stbrp_node> nodes(page_size);
+  std::vector<uint8_t> pixels;
+  size_t num_pages = 0;
+  while (!pending.empty()) {
+    stbrp_context ctx;
+    stbrp_init_target(&ctx, page_size, page_size, nodes.data(), nodes.size());
+    stbrp_pack_rects(&ctx, pending.data(), pending.size());
+    const auto unpacked = std::partition(pending.begin(), pending.end(), [](const stbrp_rect& rect) { return rect.was_packed; });
+    ASSERT(unpacked != pending.begin()); // every rect fits an empty page
+
+    // Shrink the page to the area actually used
+    int width = 0, height = 0;
+    for (auto rect = pending.begin(); rect != unpacked; rect++) {
+      width = std::max(width, rect->x + rect->w);
+      height = std::max(height, rect->y + rect->h);
+    }
+    pixels.assign(width * height * 4, 0);
+    for (auto rect = pending.begin(); rect != unpacked; rect++)
+      blit_extruded(pixels.data(), width, images[rect->id], *rect);
+    auto page = std::make_shared<GLTexture>(load_atlas_page_texture(pixels.data(), width, height, min_filter, mag_filter));
+    for (auto rect = pending.begin(); rect != unpacked; rect++) {
+      const AtlasImage& image = images[rect->id];
+      const int x = rect->x + kAtlasPadding;
+      const int y = rect->y + kAtlasPadding;
+      regions[rect->id] = TextureRegion{
+        .texture = page,
+        .texrect = { (float)x / width, (float)y / height, (float)(x + image.width) / width, (float)(y + image.height) / height },
+        .blend = classify_alpha(image.pixels.get(), (size_t)image.width * image.height),
+      };
+    }
+    DEBUG("Packed atlas page {} with {} textures ({}x{})", num_pages, std::distance(pending.begin(), unpacked), width, height);
+    pending.erase(pending.begin(), unpacked);
+    num_pages++;
+  }
+  return regions;
+}
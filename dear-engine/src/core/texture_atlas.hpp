@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include <glbinding/gl33core/gl.h>
+using namespace gl;
+
+#include "gl_texture.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Texture Atlas
+
+/// Max width/height of an atlas page, also limited by the driver's GL_MAX_TEXTURE_SIZE
+inline constexpr int kAtlasPageSize = 2048;
+
+/// Pixels around each image in an atlas page, filled by extruding the image's edges.
+/// Keeps bilinear filtering from sampling neighbour images, and together with images being
+/// aligned to it, mipmaps too up to level log2(kAtlasPadding).
+inline constexpr int kAtlasPadding = 4;
+
+/// Read the image files and pack them into as few RGBA texture pages as possible, uploading them to GPU memory.
+/// Returns the region of each image in the same order as the input paths, images on the same page share its GLTextureRef.
+auto pack_texture_atlas(const std::vector<std::string>& inpaths, GLenum min_filter, GLenum mag_filter = GLenum(0))
+    -> std::optional<std::vector<TextureRegion>>;
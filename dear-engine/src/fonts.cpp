@@ -10,6 +10,6 @@ Fonts load_fonts()
     .jetbrains = std::make_shared<GLFont>(*ASSERT_GET(load_font("JetBrainsMono-Regular.ttf"))),
     .google_sans = std::make_shared<GLFont>(*ASSERT_GET(load_font("GoogleSans-Regular.ttf"))),
     .kanit = std::make_shared<GLFont>(*ASSERT_GET(load_font("Kanit/Kanit-Bold.ttf"))),
-    .russo_one = std::make_shared<GLFont>(*ASSERT_GET(load_font("Russo_One/RussoOne-Regular.ttf"))),
+    .russo_one = std::make_shared<GLFont>(*ASSERT_GET(load_sdf_font("Russo_One/RussoOne-Regular.ttf"))),
   };
 }
@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include <functional>
 #include <fstream>
+#include <thread>
 #include <unistd.h>
 
 #include <glbinding/gl33core/gl.h>
@@ -37,6 +38,7 @@ using namespace gl;
 #include "./colors.hpp"
 #include "core/unique_num.hpp"
 #include "core/gl_object.hpp"
+#include "core/gl_state.hpp"
 #include "core/aabb.hpp"
 #include "core/sprite.hpp"
 #include "core/text.hpp"
@@ -49,6 +51,16 @@ using namespace gl;
 #include "core/viewport.hpp"
 #include "./textures.hpp"
 #include "core/renderer.hpp"
+#include "core/stream_buffer.hpp"
+#include "core/debug_draw.hpp"
+#include "core/render_target.hpp"
+#include "core/cached_layer.hpp"
+#include "core/glyph_cache.hpp"
+#include "core/render_queue.hpp"
+#include "core/frame_stream.hpp"
+#include "core/imgui_frame.hpp"
+#include "core/profiler.hpp"
+#include "core/hitch_trace.hpp"
 #include "./components.hpp"
 
 using namespace std::string_literals;
@@ -58,6 +70,7 @@ using namespace std::string_literals;
 
 static constexpr size_t kWidth = 1280;
 static constexpr size_t kHeight = 720;
+static constexpr float kHudTextHeight = 0.0528f; // HUD text font pixel height in normalized units
 static constexpr float kAspectRatio = (float)kWidth / (float)kHeight;
 static constexpr float kAspectRatioInverse = (float)kHeight / (float)kWidth;
 
@@ -72,6 +85,17 @@ using KeyStateMap = std::unordered_map<Key, bool>;
 
 void init_key_handlers(KeyHandlerMap& key_handlers);
 
+/// Engine options given in the command line
+struct EngineOptions {
+  std::optional<std::string> hitch_trace_dir;                   // save hitch traces to this directory when set
+  bool perf_counters = false;                                   // collect hardware perf counters per profiler zone
+  bool render_thread = true;                                    // render on a dedicated thread owning the GL context
+  std::optional<std::string> shader_cache_dir = "shader-cache"; // cache shader program binaries in this directory when set
+  std::optional<float> resolution_scale;                        // fixed internal resolution scale, automatic when unset
+  std::optional<float> frame_target_ms;                         // render time held by the automatic scale, refresh period when unset
+  GLenum upscale_filter = GL_LINEAR;                            // filter upscaling the internal resolution to the viewport
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Game
 
@@ -82,19 +106,22 @@ struct GameObject {
   Transform prev_transform;
   Motion motion;
   GLObjectRef glo;
-  std::optional<GLTextureRef> texture;
+  std::optional<TextureRegion> texture;
   std::optional<SpriteAnimation> sprite_animation;
   std::optional<TextFormat> text_fmt;
+  std::optional<GlyphRun> glyphs;
   std::optional<UpdateFn> update;
   std::optional<Aabb> aabb;
   std::optional<OffScreenDestroy> offscreen_destroy;
   std::optional<ScreenBound> screen_bound;
+  std::optional<InstancedSprite> instanced;
+  RenderLayer layer;
   std::optional<ALSourceRef> sound;
   std::optional<DelayErasing> delay_erasing;
   std::optional<Health> health;
 };
 
-/// Lists of all Game Objects in a Scene, divised in layers, in order of render
+/// Lists of all Game Objects in a Scene, divised by kind
 struct ObjectLists {
   std::vector<GameObject> background;
   std::vector<GameObject> spaceship;
@@ -102,14 +129,25 @@ struct ObjectLists {
   std::vector<GameObject> explosion;
   std::vector<GameObject> gui;
   std::vector<GameObject> text;
-  /// Get all layers of objects
+  /// Get all lists of objects
   auto all_lists() { return std::array{ &background, &spaceship, &projectile, &explosion, &gui, &text }; }
 };
 
+/// Render layers used when the scene file doesn't define any
+inline const std::vector<std::string> kDefaultLayers = { "background", "spaceship", "projectile", "explosion", "gui", "text" };
+
 /// Generic Scene structure
 struct Scene {
   ObjectLists objects;
+  std::vector<std::string> layers; // render layer names, in order of render
   GameObject& player() { return objects.spaceship.front(); }
+
+  /// Get a render layer by name, must be defined
+  RenderLayer layer(std::string_view name, uint16_t depth = 0) const {
+    auto it = std::find(layers.begin(), layers.end(), name);
+    ASSERT_MSG(it != layers.end(), "Undefined render layer '{}'", name);
+    return RenderLayer{ .index = static_cast<uint8_t>(it - layers.begin()), .depth = depth };
+  }
 };
 
 /// Game State/Engine
@@ -117,11 +155,17 @@ struct Game {
   bool paused;
   bool vsync;
   bool hover;
+  bool redraw;  // input or state changed since the last frame built, idle frames are skipped without it
   Cursor cursor;
   Window window;
   Viewport viewport;
   std::optional<Camera> camera;
   std::optional<Shaders> shaders;
+  std::optional<StreamBuffer> stream_buffer;
+  std::optional<GlyphCache> glyph_cache;
+  std::optional<SpriteBatch> sprite_batch;
+  std::optional<SpriteInstancer> sprite_instancer;
+  std::optional<TextBatch> text_batch;
   std::optional<Fonts> fonts;
   std::optional<Scene> scene;
   std::optional<Audios> audios;
@@ -129,18 +173,53 @@ struct Game {
   std::optional<KeyHandlerMap> key_handlers;
   std::optional<KeyStateMap> key_states;
   std::unordered_map<int, TimedAction> timed_actions;
-  Aabb screen_aabb;
+  std::optional<HitchDetector> hitch_detector;
+  Aabb world_aabb; // bounds of the simulation for the screen systems, fixed whatever the camera shows
+  size_t culled = 0; // objects outside the camera view in the last frame built
   struct {
     bool debug_info = false;
     bool aabbs = false;
   } render_opts;
+  // Render thread only, from here on
   struct {
     Transform transform;
     TextFormat text_fmt;
-    std::optional<GLObject> glo;
+    NumericText text;
   } fps, obj_counter;
+  struct {
+    std::optional<GLTexture> pause_image; // loaded on first pause
+    std::optional<GLObject> debug_glo;    // debug draw lines and shapes, streamed
+    Camera screen_camera;                 // fixed view for overlays, unaffected by camera pan and zoom
+    std::optional<RenderTarget> scene_target;   // scene at the internal resolution, while scaled down
+    std::optional<ResolutionScaler> resolution; // internal resolution scale control
+    CachedLayer hud_layer;                // fps and object counter
+    CachedLayer pause_layer;              // pause image and question
+    GLenum upscale_filter = GL_LINEAR;
+    float render_ms = 0.0f;               // time to render and present the last frame
+  } render_state;
+};
+
+/// Everything needed to render a frame, built by the game thread and consumed by the render thread
+struct RenderFrame {
+  RenderQueue queue;                // scene draws
+  std::vector<GLObjectRef> objects; // GLObjects of queued draws, kept alive so they are released on the render thread
+  std::vector<GlyphLayoutRef> glyphs; // glyph layouts of queued text, kept alive while their runs change
+  DebugDraw debug;                  // debug lines and shapes, in world space
+  Camera camera;
+  Viewport viewport;
+  float frame_time;
+  size_t obj_count;
+  size_t culled;                    // objects outside the camera view, not queued
+  bool debug_info;
+  bool paused;
+  ImGuiFrame imgui;
+  RenderStats stats;                // GL work of the last render of this frame slot, written by the render thread
+  float render_ms = 0.0f;           // time the render thread took to render and present this slot last
 };
 
+/// Double-buffered stream of frames from the game thread to the render thread
+using RenderStream = FrameStream<RenderFrame, 2>;
+
 /// Create a projectile hit explosion object
 GameObject create_explosion(Game& game)
 {
@@ -157,22 +236,16 @@ GameObject create_explosion(Game& game)
     .acceleration = glm::vec2(0.0f),
   };
   obj.texture = ASSERT_GET(game.textures->get("Explosion.png"));
-  auto [vertices, indices] = gen_sprite_quads(6);
-  obj.glo = std::make_shared<GLObject>(create_textured_globject(game.shaders->generic_shader, vertices, indices));
   obj.sprite_animation = SpriteAnimation{
     .last_transit_dt = 0,
     .curr_frame_idx = 0,
-    .frames = std::vector<SpriteFrame>{
-      { .duration = 0.04f, .ebo_offset = 00, .ebo_count = 6 },
-      { .duration = 0.04f, .ebo_offset = 12, .ebo_count = 6 },
-      { .duration = 0.04f, .ebo_offset = 24, .ebo_count = 6 },
-      { .duration = 0.04f, .ebo_offset = 36, .ebo_count = 6 },
-      { .duration = 0.04f, .ebo_offset = 48, .ebo_count = 6 },
-      { .duration = 0.06f, .ebo_offset = 60, .ebo_count = 6 },
-    },
+    .frames = gen_sprite_frames(6, 0.04f),
     .curr_cycle_count = 0,
     .max_cycles = 1,
   };
+  obj.sprite_animation->frames.back().duration = 0.06f;
+  obj.instanced = InstancedSprite{};
+  obj.layer = game.scene->layer("explosion");
   obj.sound = std::make_shared<ALSource>(create_audio_source(1.0f));
   obj.sound->get()->bind_buffer(*ASSERT_GET(game.audios->get("explosionCrunch_000.wav")));
   return obj;
@@ -194,9 +267,10 @@ GameObject create_player_projectile(Game& game)
     .acceleration = glm::vec2(0.0f),
   };
   obj.texture = ASSERT_GET(game.textures->get("Projectile01.png"));
-  obj.glo = std::make_shared<GLObject>(create_textured_quad_globject(game.shaders->generic_shader));
   obj.aabb = Aabb{ .min= {-0.11f, -0.38f}, .max = {+0.07f, +0.30f} };
   obj.offscreen_destroy = OffScreenDestroy{};
+  obj.instanced = InstancedSprite{};
+  obj.layer = game.scene->layer("projectile");
   obj.sound = std::make_shared<ALSource>(create_audio_source(0.8f));
   obj.sound->get()->bind_buffer(*ASSERT_GET(game.audios->get("laser-14729.wav")));
   return obj;
@@ -208,6 +282,7 @@ auto load_entity(Game& game, YAML::Node node) -> std::optional<GameObject>
 
   std::strncpy(obj.tag.label, node["tag"].as<std::string>().c_str(), sizeof(Tag::label));
   obj.transform = node["transform"].as<Transform>();
+  obj.layer = game.scene->layer(node["layer"] ? node["layer"].as<std::string>() : "text");
 
   return obj;
 }
@@ -216,6 +291,13 @@ void load_scene_file(Game& game)
 {
   std::string data = *ASSERT_GET(read_file_to_string(ENGINE_ASSETS_PATH + "/scene.dat"s));
   YAML::Node node = YAML::Load(data);
+  if (auto layers = node["layers"]; layers) {
+    for (auto layer : layers)
+      game.scene->layers.push_back(layer.as<std::string>());
+  }
+  if (game.scene->layers.empty())
+    game.scene->layers = kDefaultLayers;
+  ASSERT_MSG(game.scene->layers.size() <= 256, "Too many render layers ({})", game.scene->layers.size());
   if (auto entities = node["entities"]; entities) {
     for (auto entity : entities) {
       if (auto tag = entity["tag"]; tag) {
@@ -234,8 +316,8 @@ void load_scene_file(Game& game)
         //obj.transform.position = glm::vec2(-0.99f * kAspectRatio, -0.99f);
         //obj.transform.scale = glm::vec2(0.0024f);
         //obj.transform.scale.y = -obj.transform.scale.y;
-        //auto [vertices, indices, _] = gen_text_quads(*game.fonts->russo_one, tag.as<std::string>());
-        //obj.glo = std::make_shared<GLObject>(create_text_globject(game.shaders->generic_shader, vertices, indices, GL_STATIC_DRAW));
+        //obj.glyphs = GlyphRun{};
+        //obj.glyphs->set(*game.fonts->russo_one, tag.as<std::string>());
         //obj.text_fmt = TextFormat{
           //.font = game.fonts->russo_one,
           //.color = kWhiteDimmed,
@@ -257,28 +339,38 @@ int game_init(Game& game, GLFWwindow* window)
   game.paused = false;
   game.vsync = true;
   game.hover = false;
+  game.redraw = true;
   game.cursor = Cursor();
   game.window.glfw = window;
   game.window.size = glm::uvec2(kWidth, kHeight);
   game.viewport.size = glm::uvec2(kWidth, kHeight);
   game.viewport.offset = glm::uvec2(0);
   game.camera = Camera::create(kAspectRatio);
+  game.render_state.screen_camera = Camera::create(kAspectRatio);
   game.shaders = load_shaders();
+  game.stream_buffer = StreamBuffer::create();
+  game.sprite_batch = SpriteBatch::create(game.shaders->generic_shader.get(GLSub::TEXTURE), *game.stream_buffer);
+  game.sprite_instancer = SpriteInstancer::create(game.shaders->instanced_sprite_shader, *game.stream_buffer);
+  game.glyph_cache = GlyphCache();
+  game.text_batch = TextBatch::create(game.shaders->text_shader, *game.stream_buffer, *game.glyph_cache);
+  game.render_state.debug_glo = create_colored_globject(game.shaders->generic_shader.get(GLSub::COLOR), game.stream_buffer->id(), {});
   game.fonts = load_fonts();
   game.scene = Scene{};
   game.audios = Audios{};
   game.textures = Textures{};
   game.key_handlers = KeyHandlerMap(GLFW_KEY_LAST); // reserve all keys to avoid rehash
   game.key_states = KeyStateMap(GLFW_KEY_LAST);     // reserve all keys to avoid rehash
-  game.screen_aabb = Aabb{ .min = {-kAspectRatio, -1.0f}, .max = {kAspectRatio, +1.0f} };
+  game.world_aabb = Aabb{ .min = {-kAspectRatio, -1.0f}, .max = {kAspectRatio, +1.0f} };
 
   load_scene_file(game);
 
   ASSERT(game.audios->load("laser-14729.wav"));
   ASSERT(game.audios->load("explosionCrunch_000.wav"));
 
-  ASSERT(game.textures->load("Explosion.png", GL_LINEAR));
-  ASSERT(game.textures->load("Projectile01.png", GL_LINEAR));
+  // Sprites sharing a filter share atlas pages, so they batch together
+  DEBUG("Packing Sprite Textures");
+  ASSERT(game.textures->pack({ "Explosion.png", "Projectile01.png" }, GL_LINEAR));
+  ASSERT(game.textures->pack({ "background03.png", "Paranoid.png", "UFO.png" }, GL_NEAREST));
 
   { // Background
     game.scene->objects.background.push_back({});
@@ -290,14 +382,13 @@ int game_init(Game& game, GLFWwindow* window)
       .rotation = 0.0f,
     };
     background.prev_transform = background.transform;
+    background.layer = game.scene->layer("background");
     background.motion = Motion{
       .velocity = glm::vec2(0.014f, 0.004f),
       .acceleration = glm::vec2(0.0f),
     };
     DEBUG("Loading Background Texture");
-    background.texture = ASSERT_GET(game.textures->load("background03.png", GL_NEAREST));
-    DEBUG("Loading Background Quad");
-    background.glo = std::make_shared<GLObject>(create_textured_quad_globject(game.shaders->generic_shader));
+    background.texture = ASSERT_GET(game.textures->get("background03.png"));
     background.update = UpdateFn{ [] (struct GameObject& obj, float dt, float time) {
       if (obj.transform.position.x < -0.03f || obj.transform.position.x >= +0.03f)
         obj.motion.velocity.x = -obj.motion.velocity.x;
@@ -316,25 +407,18 @@ int game_init(Game& game, GLFWwindow* window)
       .rotation = 0.0f,
     };
     player.prev_transform = player.transform;
+    player.layer = game.scene->layer("spaceship");
     player.motion = Motion{
       .velocity = glm::vec2(0.0f),
       .acceleration = glm::vec2(0.0f),
     };
     DEBUG("Loading Player Spaceship Texture");
-    player.texture = ASSERT_GET(game.textures->load("Paranoid.png", GL_NEAREST));
-    DEBUG("Loading Player Spaceship Vertices");
-    auto [vertices, indices] = gen_sprite_quads(4);
-    player.glo = std::make_shared<GLObject>(create_textured_globject(game.shaders->generic_shader, vertices, indices));
+    player.texture = ASSERT_GET(game.textures->get("Paranoid.png"));
     DEBUG("Loading Player Spaceship Sprite Animation");
     player.sprite_animation = SpriteAnimation{
       .last_transit_dt = 0,
       .curr_frame_idx = 0,
-      .frames = std::vector<SpriteFrame>{
-        { .duration = 0.15, .ebo_offset = 00, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 12, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 24, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 36, .ebo_count = 6 },
-      },
+      .frames = gen_sprite_frames(4, 0.15f),
       .curr_cycle_count = 0,
       .max_cycles = 0,
     };
@@ -352,25 +436,18 @@ int game_init(Game& game, GLFWwindow* window)
       .rotation = 0.0f
     };
     enemy.prev_transform = enemy.transform;
+    enemy.layer = game.scene->layer("spaceship");
     enemy.motion = Motion{
       .velocity = glm::vec2(0.0f),
       .acceleration = glm::vec2(0.0f),
     };
     DEBUG("Loading Enemy Spaceship Texture");
-    enemy.texture = ASSERT_GET(game.textures->load("UFO.png", GL_NEAREST));
-    DEBUG("Loading Enemy Spaceship Vertices");
-    auto [vertices, indices] = gen_sprite_quads(4);
-    enemy.glo = std::make_shared<GLObject>(create_textured_globject(game.shaders->generic_shader, vertices, indices));
+    enemy.texture = ASSERT_GET(game.textures->get("UFO.png"));
     DEBUG("Loading Enemy Spaceship Sprite Animation");
     enemy.sprite_animation = SpriteAnimation{
       .last_transit_dt = 0,
       .curr_frame_idx = 0,
-      .frames = std::vector<SpriteFrame>{
-        { .duration = 0.15, .ebo_offset = 00, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 12, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 24, .ebo_count = 6 },
-        { .duration = 0.15, .ebo_offset = 36, .ebo_count = 6 },
-      },
+      .frames = gen_sprite_frames(4, 0.15f),
       .curr_cycle_count = 0,
       .max_cycles = 0,
     };
@@ -385,11 +462,10 @@ int game_init(Game& game, GLFWwindow* window)
     auto& fps = game.fps;
     fps.transform = Transform{};
     fps.transform.position = glm::vec2(-0.99f * kAspectRatio, -0.99f);
-    fps.transform.scale = glm::vec2(0.0024f);
+    fps.transform.scale = glm::vec2(kHudTextHeight / game.fonts->russo_one->pixel_height);
     fps.transform.scale.y = -fps.transform.scale.y;
     DEBUG("Loading FPS Text");
-    auto [vertices, indices, _] = gen_text_quads(*game.fonts->russo_one, "FPS 00 ms 00.000");
-    fps.glo = create_text_globject(game.shaders->generic_shader, vertices, indices, GL_DYNAMIC_DRAW);
+    fps.text = NumericText::create(*game.fonts->russo_one, "FPS ##0 ms ##0.000");
     fps.text_fmt = TextFormat{
       .font = game.fonts->russo_one,
       .color = kWhiteDimmed,
@@ -402,11 +478,10 @@ int game_init(Game& game, GLFWwindow* window)
     auto& obj = game.obj_counter;
     obj.transform = Transform{};
     obj.transform.position = glm::vec2(0.68f * kAspectRatio, -0.99f);
-    obj.transform.scale = glm::vec2(0.0024f);
+    obj.transform.scale = glm::vec2(kHudTextHeight / game.fonts->russo_one->pixel_height);
     obj.transform.scale.y = -obj.transform.scale.y;
     DEBUG("Loading OBJ Counter Text");
-    auto [vertices, indices, _] = gen_text_quads(*game.fonts->russo_one, "OBJ 000");
-    obj.glo = create_text_globject(game.shaders->generic_shader, vertices, indices, GL_DYNAMIC_DRAW);
+    obj.text = NumericText::create(*game.fonts->russo_one, "OBJ 000");
     obj.text_fmt = TextFormat{
       .font = game.fonts->russo_one,
       .color = kWhiteDimmed,
@@ -423,6 +498,7 @@ void game_resume(Game& game)
   if (!game.paused) return;
   INFO("Resuming game");
   game.paused = false;
+  game.redraw = true;
 }
 
 void game_pause(Game& game)
@@ -445,40 +521,60 @@ void game_pause(Game& game)
   }
 
   game.paused = true;
+  game.redraw = true;
 }
 
 void game_update(Game& game, float dt, float time)
 {
+  PROFILE_ZONE("game_update");
+
   // Update TimedAction's
   for (auto& timed_action : game.timed_actions) {
     timed_action.second.update(game, dt, time);
   }
 
   // Update Erasing system
-  for (auto* object_list : game.scene->objects.all_lists()) {
-    for (auto&& obj = object_list->begin(); obj != object_list->end();) {
-      if (obj->delay_erasing) {
-        bool erase = true;
-        if (obj->delay_erasing->sound && obj->sound) {
-          ALint state = 0;
-          alGetSourcei(obj->sound->get()->id, AL_SOURCE_STATE, &state);
-          if (state == AL_PLAYING)
-            erase = false;
-        }
-        if (erase) {
-          obj = object_list->erase(obj);
-          continue;
+  {
+    PROFILE_ZONE("erasing_system");
+    for (auto* object_list : game.scene->objects.all_lists()) {
+      for (auto&& obj = object_list->begin(); obj != object_list->end();) {
+        if (obj->delay_erasing) {
+          bool erase = true;
+          if (obj->delay_erasing->sound && obj->sound) {
+            ALint state = 0;
+            alGetSourcei(obj->sound->get()->id, AL_SOURCE_STATE, &state);
+            if (state == AL_PLAYING)
+              erase = false;
+          }
+          if (erase) {
+            obj = object_list->erase(obj);
+            continue;
+          }
         }
+        obj++;
       }
-      obj++;
     }
   }
 
+  // Camera Pan system
+  {
+    constexpr float kPanSpeed = 1.0f; // view half-heights per second
+    auto& keys = game.key_states.value();
+    glm::vec2 direction = glm::vec2(0.0f);
+    if (keys[GLFW_KEY_A]) direction.x -= 1.0f;
+    if (keys[GLFW_KEY_D]) direction.x += 1.0f;
+    if (keys[GLFW_KEY_S]) direction.y -= 1.0f;
+    if (keys[GLFW_KEY_W]) direction.y += 1.0f;
+    if (direction != glm::vec2(0.0f) && !ImGui::GetIO().WantCaptureKeyboard) // not while typing in ImGui
+      game.camera->pan(direction * (kPanSpeed * dt / game.camera->zoom));
+  }
+
   // Cursor Picking system
   {
+    PROFILE_ZONE("cursor_picking_system");
     game.hover = false;
-    const auto pixel_size = glm::vec2(1.f / game.viewport.size.x, 1.f / game.viewport.size.y);
-    const auto cursor_pos = game.cursor.normalized(game.window, game.viewport);
+    const auto pixel_size = glm::vec2(1.f / game.viewport.size.x, 1.f / game.viewport.size.y) / game.camera->zoom;
+    const auto cursor_pos = game.camera->to_world(game.cursor.normalized(game.window, game.viewport));
     const auto cursor_aabb = Aabb{.min = cursor_pos, .max = cursor_pos + pixel_size};
     for (auto &spaceship : game.scene->objects.spaceship) {
       if (!spaceship.aabb) continue;
@@ -490,49 +586,53 @@ void game_update(Game& game, float dt, float time)
   }
 
   // Update all objects
-  for (auto* object_list : game.scene->objects.all_lists()) {
-    for (auto& obj : *object_list) {
-      // Transform
-      obj.prev_transform = obj.transform;
-      // Motion system
-      obj.motion.velocity += obj.motion.acceleration * dt;
-      obj.transform.position += obj.motion.velocity * dt;
-      // Sprite Animation system
-      if (obj.sprite_animation) {
-        obj.sprite_animation->update_frame(dt);
-        if (obj.sprite_animation->expired()) {
-          if (!obj.delay_erasing) {
-            obj.delay_erasing = DelayErasing{.sound = true};
-            obj.transform = Transform{
-                .position = glm::vec2(1000.0f),
-            };
-            obj.prev_transform = obj.transform;
+  {
+    PROFILE_ZONE("object_systems");
+    for (auto* object_list : game.scene->objects.all_lists()) {
+      for (auto& obj : *object_list) {
+        // Transform
+        obj.prev_transform = obj.transform;
+        // Motion system
+        obj.motion.velocity += obj.motion.acceleration * dt;
+        obj.transform.position += obj.motion.velocity * dt;
+        // Sprite Animation system
+        if (obj.sprite_animation) {
+          obj.sprite_animation->update_frame(dt);
+          if (obj.sprite_animation->expired()) {
+            if (!obj.delay_erasing) {
+              obj.delay_erasing = DelayErasing{.sound = true};
+              obj.transform = Transform{
+                  .position = glm::vec2(1000.0f),
+              };
+              obj.prev_transform = obj.transform;
+            }
           }
         }
-      }
-      // Custom Update Function system
-      if (obj.update) obj.update->fn(obj, dt, time);
-      // Off-Screen Destroy system
-      if (obj.offscreen_destroy) {
-        Aabb obj_aabb = obj.aabb->transform(obj.transform.matrix());
-        if (!collision(obj_aabb, game.screen_aabb)) {
-          if (!obj.delay_erasing)
-            obj.delay_erasing = DelayErasing{};
+        // Custom Update Function system
+        if (obj.update) obj.update->fn(obj, dt, time);
+        // Off-Screen Destroy system
+        if (obj.offscreen_destroy) {
+          Aabb obj_aabb = obj.aabb->transform(obj.transform.matrix());
+          if (!collision(obj_aabb, game.world_aabb)) {
+            if (!obj.delay_erasing)
+              obj.delay_erasing = DelayErasing{};
+          }
+        }
+        // Screen Bound system
+        if (obj.screen_bound) {
+          glm::vec2& pos = obj.transform.position;
+          if (pos.x < game.world_aabb.min.x) pos.x = game.world_aabb.min.x;
+          if (pos.y < game.world_aabb.min.y) pos.y = game.world_aabb.min.y;
+          if (pos.x > game.world_aabb.max.x) pos.x = game.world_aabb.max.x;
+          if (pos.y > game.world_aabb.max.y) pos.y = game.world_aabb.max.y;
         }
-      }
-      // Screen Bound system
-      if (obj.screen_bound) {
-        glm::vec2& pos = obj.transform.position;
-        if (pos.x < game.screen_aabb.min.x) pos.x = game.screen_aabb.min.x;
-        if (pos.y < game.screen_aabb.min.y) pos.y = game.screen_aabb.min.y;
-        if (pos.x > game.screen_aabb.max.x) pos.x = game.screen_aabb.max.x;
-        if (pos.y > game.screen_aabb.max.y) pos.y = game.screen_aabb.max.y;
       }
     }
   }
 
   // Projectile<->Spaceship Collision system
   {
+    PROFILE_ZONE("projectile_collision_system");
     auto& spaceships = game.scene->objects.spaceship;
     auto&& spaceship = spaceships.begin();
     for (spaceship++ /* skip player */; spaceship != spaceships.end(); spaceship++) {
@@ -570,6 +670,7 @@ void game_update(Game& game, float dt, float time)
   // Player<->Enemy Spaceships Collision system
   if (!game.paused)
   {
+    PROFILE_ZONE("spaceship_collision_system");
     auto& spaceships = game.scene->objects.spaceship;
     auto&& player = spaceships.begin();
     auto&& enemy = spaceships.begin();
@@ -582,15 +683,15 @@ void game_update(Game& game, float dt, float time)
         explosion.prev_transform = explosion.transform;
         explosion.sound->get()->play();
         game.scene->objects.explosion.emplace_back(std::move(explosion));
-        player->glo = nullptr;
+        player->texture.reset();
         game_pause(game);
       }
     }
   }
 }
 
-/// Calculates the average FPS within kPeriod and update FPS GLObject data for render
-void update_fps(const GLShader& shader, GLObject& glo, const GLFont& font, float dt)
+/// Calculates the average FPS within kPeriod and update the FPS text for render
+void update_fps(NumericText& text, float dt)
 {
   constexpr float kPeriod = 0.3f; // second
   static size_t counter = 1;
@@ -610,34 +711,22 @@ void update_fps(const GLShader& shader, GLObject& glo, const GLFont& font, float
   static float last_fps = 0;
   if (fps != last_fps) {
     last_fps = fps;
-    char fps_cbuf[30];
     float ms = (1.f / fps) * 1000;
-    std::snprintf(fps_cbuf, sizeof(fps_cbuf), "FPS %.0f ms %.3f", fps, ms);
-    update_text_globject(shader, glo, font, fps_cbuf, GL_DYNAMIC_DRAW);
+    text.set(0, fps);
+    text.set(1, ms);
   }
 }
 
-/// Compute number of objects being rendered and update OBJ Counter GLObject for render
-void update_obj_counter(Game& game, const GLShader& shader, GLObject& glo, const GLFont& font)
+/// Update OBJ Counter text for render with the number of objects in the scene
+void update_obj_counter(NumericText& text, size_t obj_counter)
 {
-  static size_t last_obj_counter = 0;
-  size_t obj_counter = 0;
-  for (auto* object_list : game.scene->objects.all_lists())
-    obj_counter += object_list->size();
-  if (obj_counter != last_obj_counter) {
-    last_obj_counter = obj_counter;
-    char obj_cbuf[30];
-    std::snprintf(obj_cbuf, sizeof(obj_cbuf), "OBJ %03zu", obj_counter);
-    update_text_globject(shader, glo, font, obj_cbuf, GL_DYNAMIC_DRAW);
-  }
+  text.set(0, obj_counter);
 }
 
-/// Render a text in immediate mode: construct text object, draw and discard
-void immediate_draw_text(const GLShader &shader, const std::string_view text, const std::optional<glm::vec2> position, const GLFont &font,
-                         const float text_size_px, const glm::vec4 &color, const glm::vec4 &outline_color, const float outline_thickness)
+/// Transform of a text in immediate mode, sized text_size_px of the window height, centered horizontally without position
+glm::mat4 immediate_text_transform(const GlyphLayout& layout, const std::optional<glm::vec2> position, const GLFont& font,
+                                   const float text_size_px)
 {
-  const auto [vertices, indices, width] = gen_text_quads(font, text);
-  auto glo = create_text_globject(shader, vertices, indices, GL_STREAM_DRAW);
   const float normal_pixel_scale = 1.f / font.pixel_height;
   const float normal_text_scale = text_size_px / kHeight;
   float scale = normal_pixel_scale * normal_text_scale;
@@ -645,141 +734,333 @@ void immediate_draw_text(const GLShader &shader, const std::string_view text, co
   transform.scale = glm::vec2(scale);
   transform.scale.y = -transform.scale.y;
   if (position) transform.position = *position;
-  else /*center*/ transform.position.x -= transform.scale.x * (width / 2.f);
-  draw_text_object(shader, font.texture, glo, transform.matrix(), kWhite, kBlack, 1.f);
+  else /*center*/ transform.position.x -= transform.scale.x * (layout.width / 2.f);
+  return transform.matrix();
 }
 
-/// Render AABBs for all objects that have it
-void render_aabbs(Game& game, GLShader& generic_shader)
+/// Render a text in immediate mode: get its cached layout and queue its glyphs in the text batch
+void immediate_draw_text(TextBatch& batch, const std::string_view text, const std::optional<glm::vec2> position,
+                         const GLFont &font, const float text_size_px, const glm::vec4 &color, const glm::vec4 &outline_color,
+                         const float outline_thickness)
 {
-  //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  auto bbox_glo = create_colored_globject(generic_shader, kColorQuadVertices, kQuadIndices, GL_STREAM_DRAW);
-  GLushort indices[] = {0, 1, 2, 3};
-  glBindVertexArray(bbox_glo.vao);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbox_glo.ebo);
-  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(indices), indices);
-  bbox_glo.num_indices = 4;
-  for (auto* object_list : game.scene->objects.all_lists()) {
-    for (auto obj = object_list->rbegin(); obj != object_list->rend(); obj++) {
-      if (obj->aabb) {
-        Aabb& aabb = *obj->aabb;
-        auto vertices = std::vector<ColorVertex>{
-          { .pos = { aabb.max.x, aabb.max.y }, .color = { 1.0f, 1.0f, 0.0f, 1.0f } },
-          { .pos = { aabb.max.x, aabb.min.y }, .color = { 1.0f, 1.0f, 0.0f, 1.0f } },
-          { .pos = { aabb.min.x, aabb.min.y }, .color = { 1.0f, 1.0f, 0.0f, 1.0f } },
-          { .pos = { aabb.min.x, aabb.max.y }, .color = { 1.0f, 1.0f, 0.0f, 1.0f } },
-        };
-        //glBindVertexArray(bbox_glo.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, bbox_glo.vbo);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(ColorVertex), vertices.data());
-        draw_colored_object(generic_shader, bbox_glo, obj->transform.matrix());
+  const GlyphLayoutRef layout = text_layout_cache().get(font, text);
+  batch.add(font, *layout, immediate_text_transform(*layout, position, font, text_size_px), color, outline_color, outline_thickness);
+}
+
+/// Render profiler zones averaged over the history, along with their hardware counters when enabled
+void imgui_profiler_window(size_t culled)
+{
+  struct ZoneSummary {
+    const char* name;
+    uint32_t thread;
+    int64_t total_ns;
+    PerfCounts perf;
+  };
+  std::array<ZoneSummary, 32> summaries;
+  size_t num_summaries = 0;
+  const Profiler& prof = profiler();
+  const size_t num_frames = prof.history_size();
+  for (size_t age = 0; age < num_frames; age++) {
+    for (const ProfileZone& zone : prof.frame(age).zones) {
+      auto end = summaries.begin() + num_summaries;
+      auto it = std::find_if(summaries.begin(), end, [&](const ZoneSummary& summary) {
+        return summary.thread == zone.thread && !std::strcmp(summary.name, zone.name);
+      });
+      if (it == end) {
+        if (num_summaries == summaries.size()) continue;
+        *it = ZoneSummary{ .name = zone.name, .thread = zone.thread, .total_ns = 0, .perf = {} };
+        num_summaries++;
       }
+      it->total_ns += zone.end_ns - zone.begin_ns;
+      it->perf += zone.perf;
     }
   }
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  ImGui::Begin("Profiler");
+  ImGui::Text("Average of last %zu frames", num_frames);
+  if (num_frames) {
+    const RenderStats& render = prof.frame(0).render;
+    ImGui::Text("GL: %zu draws, %zu texture binds, %zu vao binds, %zu/%zu state calls issued/skipped",
+                render.draw_calls, render.texture_binds, render.vao_binds, render.gl_calls_issued, render.gl_calls_skipped);
+    ImGui::Text("Stream: %zu bytes, %zu waits", render.stream_bytes, render.stream_waits);
+    ImGui::Text("Glyphs: %zu uploads", render.glyph_uploads);
+    ImGui::Text("Instances: %zu drawn, %zu dropped", render.instances, render.instances_dropped);
+    ImGui::Text("Culled: %zu objects outside the view", culled);
+    ImGui::Text("Resolution: %.0f%% of the viewport", render.resolution_scale * 100.0f);
+  }
+  ImGui::Separator();
+  for (size_t i = 0; i < num_summaries; i++) {
+    const ZoneSummary& summary = summaries[i];
+    ImGui::Text("[%u] %-28s %8.3f ms", summary.thread, summary.name, summary.total_ns / 1e6 / num_frames);
+    if (prof.perf_counters() && summary.perf.cycles) {
+      ImGui::Text("     IPC %.2f  cache-miss MPKI %.2f  branch-miss MPKI %.2f",
+                  summary.perf.ipc(), summary.perf.cache_mpki(), summary.perf.branch_mpki());
+    }
+  }
+  ImGui::End();
 }
 
-/// Render ImGui windows
-void imgui_render(Game& game)
+/// Build ImGui windows and copy their draw data for the render thread, runs on the game thread
+void imgui_build(Game& game, ImGuiFrame& imgui_frame)
 {
-  ImGui_ImplOpenGL3_NewFrame();
+  PROFILE_ZONE("imgui_build");
   ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
 
   bool show_demo_window = true;
   ImGui::ShowDemoWindow(&show_demo_window);
 
-  ImGui::Render();
-
-  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  if (game.render_opts.debug_info)
+    imgui_profiler_window(game.culled);
 
-  if (ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-    GLFWwindow* backup_current_context = glfwGetCurrentContext();
-    ImGui::UpdatePlatformWindows();
-    ImGui::RenderPlatformWindowsDefault();
-    glfwMakeContextCurrent(backup_current_context);
-  }
+  ImGui::Render();
+  imgui_frame.copy(*ImGui::GetDrawData());
 }
 
-/// Game render everything
-void game_render(Game& game, float frame_time, float alpha)
+/// Render ImGui draw data built by the game thread, runs on the render thread
+void imgui_render(ImGuiFrame& imgui_frame)
 {
-  begin_render();
-
-  GLShader& generic_shader = game.shaders->generic_shader;
-  generic_shader.bind();
-  set_camera(generic_shader, *game.camera);
+  PROFILE_ZONE("imgui_render");
+  // Device objects were created before the render thread took the context, NewFrame would touch the shared
+  // ImGui context the game thread is building the next frame with
+  ImGui_ImplOpenGL3_RenderDrawData(imgui_frame.data());
+}
 
-  // Render all objects
+/// Build a render frame from the game state, runs on the game thread
+void build_render_frame(Game& game, RenderFrame& frame, float frame_time, float alpha)
+{
+  PROFILE_ZONE("build_render_frame");
+  GLShader& sprite_shader = game.shaders->generic_shader.get(GLSub::TEXTURE);
+  GLShader& color_shader = game.shaders->generic_shader.get(GLSub::COLOR);
+  GLShader& instanced_shader = game.shaders->instanced_sprite_shader;
+  GLShader& text_shader = game.shaders->text_shader;
+
+  // Queue all visible objects, the queue sorts them by layer then by state
+  const Aabb view_rect = game.camera->visible_rect();
+  frame.culled = 0;
   for (auto* object_list : game.scene->objects.all_lists()) {
-    for (auto obj = object_list->rbegin(); obj != object_list->rend() && obj->glo; obj++) {
+    for (auto obj = object_list->rbegin(); obj != object_list->rend(); obj++) {
+      if (!obj->texture && !obj->glo && !obj->glyphs) continue;
       // Linear interpolation
       auto transform = Transform{
         .position = glm::lerp(obj->prev_transform.position, obj->transform.position, alpha),
         .scale = glm::lerp(obj->prev_transform.scale, obj->transform.scale, alpha),
         .rotation = glm::lerp(obj->prev_transform.rotation, obj->transform.rotation, alpha),
       };
-      // Draw object
+      const glm::mat4 model = transform.matrix();
+      // Visibility culling by world bounds, objects of unknown bounds are always drawn
+      std::optional<Aabb> bounds;
       if (obj->texture) {
-        if (obj->sprite_animation) {
-          SpriteFrame& frame = obj->sprite_animation->curr_frame();
-          draw_textured_object(generic_shader, *obj->texture->get(), *obj->glo, transform.matrix(), &frame);
-        } else {
-          draw_textured_object(generic_shader, *obj->texture->get(), *obj->glo, transform.matrix());
-        }
+        bounds = Aabb{}.bounds(model); // unit quad
+      } else if (obj->glyphs && obj->glyphs->layout() && obj->text_fmt) {
+        const GlyphLayout& layout = *obj->glyphs->layout();
+        bounds = layout.bounds(obj->text_fmt->font->pixel_height).bounds(model);
+      } else if (obj->aabb) {
+        bounds = obj->aabb->bounds(model);
       }
-      else if (obj->text_fmt) {
-        draw_text_object(generic_shader, obj->text_fmt->font->texture, *obj->glo, transform.matrix(),
-                         obj->text_fmt->color, obj->text_fmt->outline_color, obj->text_fmt->outline_thickness);
+      if (bounds && !collision(*bounds, view_rect)) {
+        frame.culled++;
+        continue;
+      }
+      DrawPacket packet;
+      packet.model = model;
+      if (obj->texture) {
+        packet.kind = obj->instanced ? DrawKind::INSTANCED_SPRITE : DrawKind::SPRITE;
+        packet.shader = obj->instanced ? &instanced_shader : &sprite_shader;
+        packet.texture = obj->texture->texture.get();
+        packet.blend = obj->texture->blend;
+        packet.texrect = obj->texture->map(obj->sprite_animation ? obj->sprite_animation->curr_frame().texrect : kFullTexRect);
+      }
+      else if (obj->glyphs) {
+        if (!obj->text_fmt || !obj->glyphs->layout()) continue;
+        packet.kind = DrawKind::TEXT;
+        packet.shader = &text_shader;
+        packet.font = obj->text_fmt->font.get();
+        packet.glyphs = obj->glyphs->layout().get();
+        packet.color = obj->text_fmt->color;
+        packet.outline_color = obj->text_fmt->outline_color;
+        packet.outline_thickness = obj->text_fmt->outline_thickness;
+        frame.glyphs.push_back(obj->glyphs->layout());
       }
       else {
-        draw_colored_object(generic_shader, *obj->glo, transform.matrix());
+        packet.kind = DrawKind::COLORED;
+        packet.shader = &color_shader;
+        packet.glo = obj->glo.get();
+        frame.objects.push_back(obj->glo);
       }
+      frame.queue.submit(obj->layer.index, obj->layer.depth, packet);
     }
   }
 
-  // Render AABBs
-  if (game.render_opts.aabbs && game.hover)
-    render_aabbs(game, generic_shader);
+  // AABBs and object count
+  constexpr glm::vec4 kOutlineColor = { 1.0f, 1.0f, 0.0f, 1.0f };
+  frame.debug.clear();
+  frame.obj_count = 0;
+  for (auto* object_list : game.scene->objects.all_lists()) {
+    frame.obj_count += object_list->size();
+    if (!game.render_opts.aabbs || !game.hover) continue;
+    for (auto obj = object_list->rbegin(); obj != object_list->rend(); obj++)
+      if (obj->aabb) frame.debug.box(*obj->aabb, obj->transform.matrix(), kOutlineColor);
+  }
 
-  // Render Debug Info
-  if (game.render_opts.debug_info) {
-    auto& fps = game.fps;
-    update_fps(generic_shader, *fps.glo, *fps.text_fmt.font, frame_time);
-    draw_text_object(generic_shader, fps.text_fmt.font->texture, *fps.glo, fps.transform.matrix(),
-                     fps.text_fmt.color, fps.text_fmt.outline_color, fps.text_fmt.outline_thickness);
+  game.culled = frame.culled;
+  frame.camera = *game.camera;
+  frame.viewport = game.viewport;
+  frame.frame_time = frame_time;
+  frame.debug_info = game.render_opts.debug_info;
+  frame.paused = game.paused;
 
-    auto& objc = game.obj_counter;
-    update_obj_counter(game, generic_shader, *objc.glo, *objc.text_fmt.font);
-    draw_text_object(generic_shader, objc.text_fmt.font->texture, *objc.glo, objc.transform.matrix(),
-                     objc.text_fmt.color, objc.text_fmt.outline_color, objc.text_fmt.outline_thickness);
+  imgui_build(game, frame.imgui);
+}
+
+/// Render a frame built by the game thread, runs on the render thread
+void game_render(Game& game, RenderFrame& frame)
+{
+  PROFILE_ZONE("game_render");
+  auto& render_state = game.render_state;
+  flush_gl_releases(); // objects whose last reference the game thread dropped
+  gl_state().viewport(frame.viewport.offset.x, frame.viewport.offset.y, frame.viewport.size.x, frame.viewport.size.y);
+  begin_render();
+
+  // Scene renders offscreen at the internal resolution when scaled down, overlays at full resolution after upscaling it
+  const float scale = render_state.resolution->update(render_state.render_ms);
+  render_stats().resolution_scale = scale;
+  RenderTarget* scene_target = nullptr;
+  // At full scale the target is only bypassed, it's kept as the scaler moves in and out of full scale
+  if (scale < 1.0f) {
+    auto& target = render_state.scene_target;
+    const glm::uvec2 size = frame.viewport.size;
+    if (!target || size.x > target->capacity().x || size.y > target->capacity().y) {
+      target.reset();
+      target = RenderTarget::create(size);
+    }
+    if (target) {
+      scene_target = &*target;
+      scene_target->begin(render_state.resolution->apply(size));
+    }
   }
 
-  // Render Game Pause
-  if (game.paused) {
-    immediate_draw_text(generic_shader, "Qual das alternativas e uma Funcao Injetora?", std::nullopt, *game.fonts->russo_one, 50.f, kWhite, kBlack, 1.f);
+  GLShader& sprite_shader = game.shaders->generic_shader.get(GLSub::TEXTURE);
+  GLShader& color_shader = game.shaders->generic_shader.get(GLSub::COLOR);
+  GLShader& text_shader = game.shaders->text_shader;
+  SpriteBatch& sprite_batch = *game.sprite_batch;
+  TextBatch& text_batch = *game.text_batch;
+
+  // Render all objects
+  frame.queue.execute(frame.camera, sprite_batch, *game.sprite_instancer, text_batch);
+  frame.objects.clear();
+  frame.glyphs.clear();
+
+  // Render Debug Draw
+  if (!frame.debug.empty()) {
+    color_shader.bind();
+    set_camera(color_shader, frame.camera);
+    draw_debug(color_shader, *game.stream_buffer, *render_state.debug_glo, frame.debug);
+  }
 
-    GameObject obj;
-    obj.transform = Transform{
+  // Upscale the scene to the viewport
+  if (scene_target)
+    scene_target->end(frame.viewport, render_state.upscale_filter);
+
+  // Render Game Pause, cached as it doesn't change while paused
+  if (frame.paused) {
+    constexpr std::string_view kPauseText = "Qual das alternativas é uma Função Injetora?";
+    constexpr float kPauseTextSize = 50.f;
+    auto transform = Transform{
       .position = glm::vec2(0.f, -0.45f),
-        .scale = glm::vec2(1.f, 0.3f),
-        .rotation = 0.0f,
+      .scale = glm::vec2(1.f, 0.3f),
+      .rotation = 0.0f,
     };
-    obj.texture = ASSERT_GET(game.textures->load("funcoes.png", GL_LINEAR));
-    obj.glo = std::make_shared<GLObject>(create_textured_quad_globject(game.shaders->generic_shader));
-    draw_textured_object(generic_shader, *obj.texture->get(), *obj.glo, obj.transform.matrix());
+    const GLFont& font = *game.fonts->russo_one;
+    const GlyphLayoutRef text_layout = text_layout_cache().get(font, kPauseText);
+    const Aabb text_bounds = text_layout->bounds(font.pixel_height).bounds(immediate_text_transform(*text_layout, std::nullopt, font, kPauseTextSize));
+    const Aabb bounds = Aabb{}.bounds(transform.matrix()).merge(text_bounds);
+    auto& layer = render_state.pause_layer;
+    if (layer.begin(render_state.screen_camera, frame.viewport, bounds, 0)) {
+      if (!render_state.pause_image)
+        render_state.pause_image = ASSERT_GET(load_rgba_texture("funcoes.png", GL_LINEAR));
+      sprite_shader.bind();
+      set_camera(sprite_shader, layer.camera());
+      sprite_batch.draw(sprite_shader, *render_state.pause_image, transform.matrix());
+      sprite_batch.flush();
+      immediate_draw_text(text_batch, kPauseText, std::nullopt, font, kPauseTextSize, kWhite, kBlack, 1.f);
+      text_shader.bind();
+      set_camera(text_shader, layer.camera());
+      text_batch.flush(text_shader);
+      layer.end(frame.viewport);
+    }
+    sprite_shader.bind();
+    set_camera(sprite_shader, render_state.screen_camera);
+    layer.draw(sprite_shader, sprite_batch);
+  }
+
+  // Render overlay text, cached until its digits change
+  if (frame.debug_info) {
+    auto& fps = game.fps;
+    auto& objc = game.obj_counter;
+    update_fps(fps.text, frame.frame_time);
+    update_obj_counter(objc.text, frame.obj_count);
+    const Aabb bounds = fps.text.layout().bounds(fps.text_fmt.font->pixel_height).bounds(fps.transform.matrix())
+                          .merge(objc.text.layout().bounds(objc.text_fmt.font->pixel_height).bounds(objc.transform.matrix()));
+    // Both versions only grow, so their sum changes whenever either text does
+    const uint64_t key = fps.text.version() + objc.text.version();
+    auto& layer = render_state.hud_layer;
+    if (layer.begin(render_state.screen_camera, frame.viewport, bounds, key)) {
+      text_batch.add(*fps.text_fmt.font, fps.text.layout(), fps.transform.matrix(),
+                     fps.text_fmt.color, fps.text_fmt.outline_color, fps.text_fmt.outline_thickness);
+      text_batch.add(*objc.text_fmt.font, objc.text.layout(), objc.transform.matrix(),
+                     objc.text_fmt.color, objc.text_fmt.outline_color, objc.text_fmt.outline_thickness);
+      text_shader.bind();
+      set_camera(text_shader, layer.camera());
+      text_batch.flush(text_shader);
+      layer.end(frame.viewport);
+    }
+    sprite_shader.bind();
+    set_camera(sprite_shader, render_state.screen_camera);
+    layer.draw(sprite_shader, sprite_batch);
   }
 
   // Render Cursor
   //auto cursor_pos = normalized_cursor_pos(game.cursor, game.winsize);
-  //auto cursor_obj = create_colored_quad_globject(generic_shader);
+  //auto cursor_obj = create_colored_quad_globject(color_shader);
   //auto transform = Transform{};
   //transform.scale = glm::vec2(0.03f);
   //transform.position = glm::vec2(cursor_pos.x, cursor_pos.y);
-  //draw_colored_object(generic_shader, cursor_obj, transform.matrix());
+  //draw_colored_object(color_shader, cursor_obj, transform.matrix());
 
   // Render ImGui
-  imgui_render(game);
+  imgui_render(frame.imgui);
+
+  game.stream_buffer->end_frame();
+  game.glyph_cache->end_frame();
+}
+
+/// Render the next frame of the stream and present it, returns false once the stream is closed
+bool render_next_frame(Game& game, GLFWwindow* window, RenderStream& stream)
+{
+  RenderFrame* frame = stream.begin_read();
+  if (!frame) return false;
+  const double begin_time = glfwGetTime();
+  game_render(game, *frame);
+  {
+    PROFILE_ZONE("swap_buffers");
+    glfwSwapBuffers(window);
+  }
+  game.render_state.render_ms = (float)((glfwGetTime() - begin_time) * 1000.0);
+  frame->stats = render_stats();
+  frame->render_ms = game.render_state.render_ms;
+  stream.end_read();
+  return true;
+}
+
+/// Render thread entry, owns the GL context until the stream is closed
+void render_thread_main(Game& game, GLFWwindow* window, RenderStream& stream)
+{
+  glfwMakeContextCurrent(window);
+  set_gl_owner_thread();
+  while (render_next_frame(game, window, stream)) {}
+  clear_gl_owner_thread();
+  glfwMakeContextCurrent(nullptr);
 }
 
 void game_end(Game& game)
@@ -787,7 +1068,7 @@ void game_end(Game& game)
   save_scene_file(game);
 }
 
-int game_loop(GLFWwindow* window)
+int game_loop(GLFWwindow* window, const EngineOptions& options)
 {
   //while (!glfwWindowShouldClose(window)) {
     //glfwPollEvents();
@@ -797,48 +1078,119 @@ int game_loop(GLFWwindow* window)
   //return 0;
 
   Game game;
+  if (options.shader_cache_dir)
+    enable_shader_cache(*options.shader_cache_dir);
   int ret = game_init(game, window);
   if (ret) return ret;
+  if (options.hitch_trace_dir)
+    game.hitch_detector.emplace(*options.hitch_trace_dir);
+  game.render_state.upscale_filter = options.upscale_filter;
+  profiler().set_perf_counters(options.perf_counters);
   init_key_handlers(*game.key_handlers);
   glfwSetWindowUserPointer(window, &game);
   GLFWmonitor *monitor = glfwGetPrimaryMonitor();
   const GLFWvidmode *mode = glfwGetVideoMode(monitor);
   const float refresh_rate = mode->refreshRate;
+  if (options.resolution_scale)
+    game.render_state.resolution = ResolutionScaler::fixed(*options.resolution_scale);
+  else
+    game.render_state.resolution = ResolutionScaler(options.frame_target_ms.value_or(1000.f / refresh_rate));
+
+  // Frames are built here and rendered on the render thread, which owns the GL context from now on.
+  // The ImGui GL backend creates its device objects on first NewFrame, do it before handing the context over.
+  RenderStream render_stream;
+  ImGui_ImplOpenGL3_NewFrame();
+  std::optional<std::thread> render_thread;
+  if (options.render_thread) {
+    glfwMakeContextCurrent(nullptr);
+    clear_gl_owner_thread();
+    render_thread.emplace(render_thread_main, std::ref(game), window, std::ref(render_stream));
+  }
 
   float epochtime = 0;
   float last_time = 0;
   float update_lag = 0;
   float render_lag = 0;
+  bool idle = false;
   constexpr float timestep = 1.f / 100.f;
+  constexpr float kIdleRefreshRate = 10.f; // max frames per second while paused, only when input or state changed
+  constexpr float kIdleWaitTimeout = 0.5f; // max seconds waiting for events while paused, to check for window close
 
   while (!glfwWindowShouldClose(window)) {
+    // Record zones only while the hitch detector or the profiler window reads them
+    profiler().set_enabled(game.hitch_detector || game.render_opts.debug_info);
     float now_time = glfwGetTime();
     float loop_time = now_time - last_time;
     last_time = now_time;
 
-    update_lag += loop_time;
-    while (update_lag >= timestep) {
+    const float render_interval = game.vsync ? (1.f / (refresh_rate + 0.5f)) : 0.0f;
+    render_lag += loop_time;
+    if (game.paused) {
+      // Idle: the simulation is suspended, events are still handled as they come
+      PROFILE_ZONE("idle");
+      idle = true;
+      update_lag = 0;
       glfwPollEvents();
-      game_update(game, timestep, epochtime);
-      epochtime += timestep;
-      update_lag -= timestep;
+    } else {
+      if (idle) { // resumed, start over as if the last frame was just rendered
+        idle = false;
+        render_lag = render_interval;
+      }
+      update_lag += loop_time;
+      while (update_lag >= timestep) {
+        PROFILE_ZONE("tick");
+        glfwPollEvents();
+        game_update(game, timestep, epochtime);
+        epochtime += timestep;
+        update_lag -= timestep;
+      }
     }
 
-    render_lag += loop_time;
-    const float render_interval = game.vsync ? (1.f / (refresh_rate + 0.5f)) : 0.0f;
-    if (render_lag >= render_interval) {
+    // While idle, frames are only built for input or state changes, at the idle refresh rate
+    const bool frame_due = idle ? (game.redraw && render_lag >= 1.f / kIdleRefreshRate) : (render_lag >= render_interval);
+    // Skip the frame when the render thread still holds both slots, it'll be built on a later loop
+    RenderFrame* frame = frame_due ? render_stream.try_begin_write() : nullptr;
+    if (frame) {
+      // Stats of the slot's last render, one slot behind the frame being built
+      RenderStats stats = frame->stats;
+      float render_ms = frame->render_ms;
       float alpha = update_lag / timestep;
-      game_render(game, render_lag, alpha);
-      glfwSwapBuffers(window);
+      game.redraw = false;
+      build_render_frame(game, *frame, render_lag, alpha);
+      render_stream.end_write();
+      if (!render_thread) {
+        render_next_frame(game, window, render_stream);
+        stats = frame->stats;
+        render_ms = frame->render_ms;
+      }
+      profiler().end_frame(stats);
+      if (game.hitch_detector && !idle) // idle frames are late on purpose
+        game.hitch_detector->update(profiler(), render_ms / 1000.f);
       render_lag = 0;
     }
 
-    float next_loop_time_diff_us = std::min(timestep - update_lag, render_interval - render_lag);
+    if (idle) {
+      // Sleep until an event comes, or the next idle frame is due for changes already seen
+      const float idle_interval = 1.f / kIdleRefreshRate;
+      glfwWaitEventsTimeout(game.redraw ? std::max(idle_interval - render_lag, 0.f) : kIdleWaitTimeout);
+      continue;
+    }
+
+    float next_loop_time_diff_us = timestep - update_lag;
+    if (render_lag < render_interval)
+      next_loop_time_diff_us = std::min(next_loop_time_diff_us, render_interval - render_lag);
     next_loop_time_diff_us *= 1'000'000.f;
     if (next_loop_time_diff_us > 10.f)
       usleep(next_loop_time_diff_us / 2.f);
   }
 
+  render_stream.close();
+  if (render_thread) {
+    render_thread->join();
+    glfwMakeContextCurrent(window);
+    set_gl_owner_thread();
+  }
+  flush_gl_releases();
   game_end(game);
   return 0;
 }
@@ -938,6 +1290,12 @@ void key_f6_handler(struct Game& game, int key, int action, int mods)
     game.vsync = !game.vsync;
 }
 
+void key_home_handler(struct Game& game, int key, int action, int mods)
+{
+  if (action == GLFW_PRESS)
+    game.camera = Camera::create(kAspectRatio);
+}
+
 void init_key_handlers(KeyHandlerMap& key_handlers)
 {
   key_handlers[GLFW_KEY_LEFT] = key_left_right_handler;
@@ -948,6 +1306,7 @@ void init_key_handlers(KeyHandlerMap& key_handlers)
   key_handlers[GLFW_KEY_F3] = key_f3_handler;
   key_handlers[GLFW_KEY_F6] = key_f6_handler;
   key_handlers[GLFW_KEY_F7] = key_f7_handler;
+  key_handlers[GLFW_KEY_HOME] = key_home_handler;
 }
 
 void key_event_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -959,6 +1318,7 @@ void key_event_callback(GLFWwindow* window, int key, int scancode, int action, i
     return;
 
   TRACE("Event key: {} action: {} mods: {}", key, action, mods);
+  game->redraw = true;
 
   auto it = game->key_handlers->find(key);
   if (it != game->key_handlers->end()) {
@@ -996,7 +1356,6 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     x_rest = width - (height * kAspectRatio);
   float x_off = x_rest / 2.f;
   float y_off = y_rest / 2.f;
-  glViewport(x_off, y_off, (width - x_rest), (height - y_rest));
 
   game->window.size.y = height;
   game->window.size.x = width;
@@ -1004,6 +1363,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   game->viewport.size.y = (height - y_rest);
   game->viewport.offset.x = x_off;
   game->viewport.offset.y = y_off;
+  game->redraw = true;
 }
 
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
@@ -1012,6 +1372,25 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
   if (!game) return;
   game->cursor.pos.x = (float)xpos;
   game->cursor.pos.y = (float)ypos;
+  game->redraw = true;
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+  auto game = static_cast<Game*>(glfwGetWindowUserPointer(window));
+  if (!game) return;
+  game->redraw = true; // handled by ImGui, which chains this callback
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+  auto game = static_cast<Game*>(glfwGetWindowUserPointer(window));
+  if (!game) return;
+  game->redraw = true;
+  if (ImGui::GetIO().WantCaptureMouse) return;
+  // Zoom towards the cursor
+  constexpr float kZoomStep = 1.1f;
+  game->camera->zoom_by(std::pow(kZoomStep, (float)yoffset), game->cursor.normalized(game->window, game->viewport));
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1054,6 +1433,7 @@ int create_window(GLFWwindow*& window)
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_DEPTH_BITS, 24); // opaque draws are depth tested
 
   window = glfwCreateWindow(kWidth, kHeight, "inmath", nullptr, nullptr);
   if (window == nullptr) {
@@ -1062,12 +1442,15 @@ int create_window(GLFWwindow*& window)
     return -3;
   }
   glfwMakeContextCurrent(window);
+  set_gl_owner_thread();
 
   // callbacks
   glfwSetKeyCallback(window, key_event_callback);
   glfwSetWindowFocusCallback(window, window_focus_callback);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   glfwSetCursorPosCallback(window, cursor_position_callback);
+  glfwSetScrollCallback(window, scroll_callback);
+  glfwSetMouseButtonCallback(window, mouse_button_callback);
 
   // settings
   glfwSetWindowAspectRatio(window, kWidth, kHeight);
@@ -1083,6 +1466,7 @@ int main(int argc, char *argv[])
 {
   int ret = 0;
   auto log_level = spdlog::level::info;
+  EngineOptions options;
 
   // Parse Arguments ===========================================================
   for (int argi = 1; argi < argc; ++argi) {
@@ -1094,6 +1478,46 @@ int main(int argc, char *argv[])
         fprintf(stderr, "--log: missing argument\n");
         return -2;
       }
+    } else if (!strcmp(argv[argi], "--perf-counters")) {
+      options.perf_counters = true;
+    } else if (!strcmp(argv[argi], "--no-render-thread")) {
+      options.render_thread = false;
+    } else if (!strcmp(argv[argi], "--shader-cache")) {
+      argi++;
+      if (argi < argc) {
+        options.shader_cache_dir = argv[argi];
+      } else {
+        fprintf(stderr, "--shader-cache: missing argument\n");
+        return -2;
+      }
+    } else if (!strcmp(argv[argi], "--no-shader-cache")) {
+      options.shader_cache_dir.reset();
+    } else if (!strcmp(argv[argi], "--resolution-scale")) {
+      argi++;
+      if (argi < argc) {
+        options.resolution_scale = std::clamp((float)atof(argv[argi]), 0.1f, 1.0f);
+      } else {
+        fprintf(stderr, "--resolution-scale: missing argument\n");
+        return -2;
+      }
+    } else if (!strcmp(argv[argi], "--frame-target")) {
+      argi++;
+      if (argi < argc) {
+        options.frame_target_ms = (float)atof(argv[argi]);
+      } else {
+        fprintf(stderr, "--frame-target: missing argument\n");
+        return -2;
+      }
+    } else if (!strcmp(argv[argi], "--upscale-nearest")) {
+      options.upscale_filter = GL_NEAREST;
+    } else if (!strcmp(argv[argi], "--hitch-trace")) {
+      argi++;
+      if (argi < argc) {
+        options.hitch_trace_dir = argv[argi];
+      } else {
+        fprintf(stderr, "--hitch-trace: missing argument\n");
+        return -2;
+      }
     } else {
       fprintf(stderr, "unknown argument: %s\n", argv[argi]);
       return -1;
@@ -1136,7 +1560,7 @@ int main(int argc, char *argv[])
 
   // Game Loop =================================================================
   INFO("Game Loop..");
-  ret = game_loop(window);
+  ret = game_loop(window, options);
 
   // End =======================================================================
   INFO("Terminating..");
@@ -5,57 +5,95 @@
 /// Loads all shaders used by the game
 Shaders load_shaders()
 {
+  // Submit every program before finishing any, so drivers with compiler threads build them all at once
+  auto generic = submit_generic_shader();
+  auto instanced_sprite = submit_instanced_sprite_shader();
+  auto text = submit_text_shader();
+  // Finish the programs the driver already completed first, only waiting on the first submitted when none is
+  std::optional<GLShaderVariants> generic_shader;
+  std::optional<GLShader> instanced_sprite_shader;
+  std::optional<GLShader> text_shader;
+  while (!generic_shader || !instanced_sprite_shader || !text_shader) {
+    bool finished = false;
+    if (!generic_shader && GLShaderVariants::ready(generic)) {
+      generic_shader.emplace(load_generic_shader(std::move(generic)));
+      finished = true;
+    }
+    if (!instanced_sprite_shader && instanced_sprite.ready()) {
+      instanced_sprite_shader.emplace(load_instanced_sprite_shader(std::move(instanced_sprite)));
+      finished = true;
+    }
+    if (!text_shader && text.ready()) {
+      text_shader.emplace(load_text_shader(std::move(text)));
+      finished = true;
+    }
+    if (finished) continue;
+    if (!generic_shader)
+      generic_shader.emplace(load_generic_shader(std::move(generic)));
+    else if (!instanced_sprite_shader)
+      instanced_sprite_shader.emplace(load_instanced_sprite_shader(std::move(instanced_sprite)));
+    else
+      text_shader.emplace(load_text_shader(std::move(text)));
+  }
   return {
-    .generic_shader = load_generic_shader(),
+    .generic_shader = std::move(*generic_shader),
+    .instanced_sprite_shader = std::move(*instanced_sprite_shader),
+    .text_shader = std::move(*text_shader),
   };
 }
 
-/// Load Generic Shader
-/// (supports rendering: Colored objects, Textured objects and BitmapFont text)
-auto load_generic_shader() -> GLShader
+/// Submit Generic Shader variants build
+/// (supports rendering: Colored objects, Textured objects and BitmapFont text, one variant each)
+auto submit_generic_shader() -> std::vector<PendingGLShader>
 {
   static constexpr std::string_view kShaderVert = R"(
 #version 330 core
-in vec2 aPosition;
-in vec2 aTexCoord;
-in vec4 aColor;
-out vec4 fColor;
+layout(location = 0) in vec2 aPosition;
+#if defined(GLSUB_TEXTURE) || defined(GLSUB_FONT)
+layout(location = 1) in vec2 aTexCoord;
 out vec2 fTexCoord;
+#endif
+#ifdef GLSUB_COLOR
+layout(location = 2) in vec4 aColor;
+out vec4 fColor;
+#endif
 uniform mat4 uModel;
 uniform mat4 uView;
 uniform mat4 uProjection;
+uniform float uDepth;
 void main()
 {
   gl_Position = uProjection * uView * uModel * vec4(aPosition, 0.0f, 1.0f);
+  gl_Position.z = uDepth;
+#if defined(GLSUB_TEXTURE) || defined(GLSUB_FONT)
   fTexCoord = aTexCoord;
+#endif
+#ifdef GLSUB_COLOR
   fColor = aColor;
+#endif
 }
 )";
 
   static constexpr std::string_view kShaderFrag = R"(
 #version 330 core
-in vec2 fTexCoord;
-in vec4 fColor;
 out vec4 outColor;
+#ifdef GLSUB_TEXTURE
+in vec2 fTexCoord;
+uniform sampler2D uTexture0;
+uniform float uAlphaCutoff;
+void main()
+{
+  outColor = texture(uTexture0, fTexCoord);
+  if (outColor.a < uAlphaCutoff) discard;
+}
+#endif
+#ifdef GLSUB_FONT
+in vec2 fTexCoord;
 uniform sampler2D uTexture0;
 uniform vec4 uColor;
 uniform vec4 uOutlineColor;
 uniform float uOutlineThickness;
-uniform int uSubRoutine;
-vec4 font_color();
 void main()
-{
-  if (uSubRoutine == 0) {
-    outColor = texture(uTexture0, fTexCoord);
-  } else if (uSubRoutine == 1) {
-    outColor = font_color();
-  } else if (uSubRoutine == 2) {
-    outColor = fColor;
-  } else {
-    outColor = uColor;
-  }
-}
-vec4 font_color()
 {
   vec2 Offset = 1.0 / textureSize(uTexture0, 0) * uOutlineThickness;
   vec4 n = texture2D(uTexture0, vec2(fTexCoord.x, fTexCoord.y - Offset.y));
@@ -70,26 +108,220 @@ vec4 font_color()
   GrowedAlpha = mix(GrowedAlpha, 1.0, e.r);
   vec4 OutlineColorWithNewAlpha = vec4(uOutlineColor.rgb, uOutlineColor.a * GrowedAlpha);
   vec4 CharColor = TexColor * uColor;
-  return mix(OutlineColorWithNewAlpha, CharColor, CharColor.a);
+  outColor = mix(OutlineColorWithNewAlpha, CharColor, CharColor.a);
+}
+#endif
+#ifdef GLSUB_COLOR
+in vec4 fColor;
+void main()
+{
+  outColor = fColor;
 }
+#endif
 )";
 
+  DEBUG("Submitting Generic Shader");
+  return GLShaderVariants::submit("GenericShader", kShaderVert, kShaderFrag);
+}
+
+/// Finish Generic Shader variants build and load their locations
+auto load_generic_shader(std::vector<PendingGLShader> pending) -> GLShaderVariants
+{
   DEBUG("Loading Generic Shader");
-  auto shader = GLShader::build("GenericShader", kShaderVert, kShaderFrag);
+  auto variants = GLShaderVariants::finish(std::move(pending));
+  ASSERT(variants);
+  // Each variant only has the locations its path uses, the others are optimized out
+  for (GLSub sub : { GLSub::TEXTURE, GLSub::FONT, GLSub::COLOR }) {
+    GLShader& shader = variants->get(sub);
+    shader.bind();
+    shader.load_attr_loc(GLAttr::POSITION, "aPosition");
+    shader.load_unif_loc(GLUnif::MODEL, "uModel");
+    shader.load_unif_loc(GLUnif::VIEW, "uView");
+    shader.load_unif_loc(GLUnif::PROJECTION, "uProjection");
+    shader.load_unif_loc(GLUnif::DEPTH, "uDepth");
+    if (sub == GLSub::COLOR) {
+      shader.load_attr_loc(GLAttr::COLOR, "aColor");
+    } else {
+      shader.load_attr_loc(GLAttr::TEXCOORD, "aTexCoord");
+      shader.load_unif_loc(GLUnif::TEXTURE0, "uTexture0");
+    }
+    if (sub == GLSub::TEXTURE) {
+      shader.load_unif_loc(GLUnif::ALPHA_CUTOFF, "uAlphaCutoff");
+    }
+    if (sub == GLSub::FONT) {
+      shader.load_unif_loc(GLUnif::COLOR, "uColor");
+      shader.load_unif_loc(GLUnif::OUTLINE_COLOR, "uOutlineColor");
+      shader.load_unif_loc(GLUnif::OUTLINE_THICKNESS, "uOutlineThickness");
+    }
+  }
+
+  return std::move(*variants);
+}
+
+
+/// Submit Instanced Sprite Shader build
+/// (renders instances of a textured quad, each with its own transform, texture rect and tint,
+/// the quad's corners are generated from gl_VertexID, drawn as a 4 vertices triangle strip)
+auto submit_instanced_sprite_shader() -> PendingGLShader
+{
+  static constexpr std::string_view kShaderVert = R"(
+#version 330 core
+in mat3x2 aModel;
+in vec4 aTexRect;
+in vec4 aColor;
+out vec2 fTexCoord;
+out vec4 fColor;
+uniform mat4 uView;
+uniform mat4 uProjection;
+uniform float uDepth;
+void main()
+{
+  // Strip corners (0,0) (1,0) (0,1) (1,1), mapped to the unit quad (-1,-1 to +1,+1)
+  vec2 Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  gl_Position = uProjection * uView * vec4(aModel * vec3(Corner * 2.0f - 1.0f, 1.0f), 0.0f, 1.0f);
+  gl_Position.z = uDepth;
+  fTexCoord = mix(aTexRect.xy, aTexRect.zw, Corner);
+  fColor = aColor;
+}
+)";
+
+  static constexpr std::string_view kShaderFrag = R"(
+#version 330 core
+in vec2 fTexCoord;
+in vec4 fColor;
+out vec4 outColor;
+uniform sampler2D uTexture0;
+uniform float uAlphaCutoff;
+void main()
+{
+  outColor = texture(uTexture0, fTexCoord) * fColor;
+  if (outColor.a < uAlphaCutoff) discard;
+}
+)";
+
+  DEBUG("Submitting Instanced Sprite Shader");
+  return GLShader::submit("InstancedSpriteShader", kShaderVert, kShaderFrag);
+}
+
+/// Finish Instanced Sprite Shader build and load its locations
+auto load_instanced_sprite_shader(PendingGLShader pending) -> GLShader
+{
+  DEBUG("Loading Instanced Sprite Shader");
+  auto shader = pending.finish();
   ASSERT(shader);
   shader->bind();
-  shader->load_attr_loc(GLAttr::POSITION, "aPosition");
-  shader->load_attr_loc(GLAttr::TEXCOORD, "aTexCoord");
+  shader->load_attr_loc(GLAttr::MODEL, "aModel");
+  shader->load_attr_loc(GLAttr::TEXRECT, "aTexRect");
   shader->load_attr_loc(GLAttr::COLOR, "aColor");
-  shader->load_unif_loc(GLUnif::MODEL, "uModel");
   shader->load_unif_loc(GLUnif::VIEW, "uView");
   shader->load_unif_loc(GLUnif::PROJECTION, "uProjection");
   shader->load_unif_loc(GLUnif::TEXTURE0, "uTexture0");
-  shader->load_unif_loc(GLUnif::COLOR, "uColor");
-  shader->load_unif_loc(GLUnif::OUTLINE_COLOR, "uOutlineColor");
-  shader->load_unif_loc(GLUnif::OUTLINE_THICKNESS, "uOutlineThickness");
-  shader->load_unif_loc(GLUnif::SUBROUTINE, "uSubRoutine");
+  shader->load_unif_loc(GLUnif::DEPTH, "uDepth");
+  shader->load_unif_loc(GLUnif::ALPHA_CUTOFF, "uAlphaCutoff");
 
   return std::move(*shader);
 }
 
+
+/// Submit Text Shader build
+/// (renders batched bitmap or SDF font glyphs, one instance each placed in world space with its text's color and
+/// outline, the glyph quad's corners are generated from gl_VertexID, drawn as a 4 vertices triangle strip)
+auto submit_text_shader() -> PendingGLShader
+{
+  static constexpr std::string_view kShaderVert = R"(
+#version 330 core
+in mat3x2 aModel;
+in vec4 aTexRect;
+in vec4 aColor;
+in vec4 aOutlineColor;
+in float aOutlineThickness;
+out vec2 fTexCoord;
+flat out vec4 fColor;
+flat out vec4 fOutlineColor;
+flat out float fOutlineThickness;
+uniform mat4 uView;
+uniform mat4 uProjection;
+uniform float uDepth;
+void main()
+{
+  // Strip corners (0,0) (1,0) (0,1) (1,1), the model maps them to the glyph quad
+  vec2 Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  gl_Position = uProjection * uView * vec4(aModel * vec3(Corner, 1.0f), 0.0f, 1.0f);
+  gl_Position.z = uDepth;
+  fTexCoord = mix(aTexRect.xy, aTexRect.zw, Corner);
+  fColor = aColor;
+  fOutlineColor = aOutlineColor;
+  fOutlineThickness = aOutlineThickness;
+}
+)";
+
+  static constexpr std::string_view kShaderFrag = R"(
+#version 330 core
+in vec2 fTexCoord;
+flat in vec4 fColor;
+flat in vec4 fOutlineColor;
+flat in float fOutlineThickness;
+out vec4 outColor;
+uniform sampler2D uTexture0;
+uniform float uSdfSpread;
+vec4 sdf_color();
+vec4 bitmap_color();
+void main()
+{
+  outColor = (uSdfSpread > 0.0) ? sdf_color() : bitmap_color();
+}
+vec4 sdf_color()
+{
+  // Distance is 0.5 at the glyph edge and falls to 0 uSdfSpread texels outside of it
+  float Dist = texture(uTexture0, fTexCoord).r;
+  float Smoothing = max(fwidth(Dist) * 0.5, 1e-4);
+  float Fill = smoothstep(0.5 - Smoothing, 0.5 + Smoothing, Dist);
+  float OutlineEdge = 0.5 - min(fOutlineThickness, uSdfSpread) / (2.0 * uSdfSpread);
+  float Outline = smoothstep(OutlineEdge - Smoothing, OutlineEdge + Smoothing, Dist);
+  vec4 CharColor = vec4(fColor.rgb, fColor.a * Fill);
+  vec4 OutlineColor = vec4(fOutlineColor.rgb, fOutlineColor.a * Outline);
+  return mix(OutlineColor, CharColor, Fill);
+}
+vec4 bitmap_color()
+{
+  vec2 Offset = 1.0 / textureSize(uTexture0, 0) * fOutlineThickness;
+  float n = texture(uTexture0, vec2(fTexCoord.x, fTexCoord.y - Offset.y)).r;
+  float e = texture(uTexture0, vec2(fTexCoord.x + Offset.x, fTexCoord.y)).r;
+  float s = texture(uTexture0, vec2(fTexCoord.x, fTexCoord.y + Offset.y)).r;
+  float w = texture(uTexture0, vec2(fTexCoord.x - Offset.x, fTexCoord.y)).r;
+  vec4 TexColor = vec4(vec3(1.0), texture(uTexture0, fTexCoord).r);
+  float GrowedAlpha = TexColor.a;
+  GrowedAlpha = mix(GrowedAlpha, 1.0, s);
+  GrowedAlpha = mix(GrowedAlpha, 1.0, w);
+  GrowedAlpha = mix(GrowedAlpha, 1.0, n);
+  GrowedAlpha = mix(GrowedAlpha, 1.0, e);
+  vec4 OutlineColorWithNewAlpha = vec4(fOutlineColor.rgb, fOutlineColor.a * GrowedAlpha);
+  vec4 CharColor = TexColor * fColor;
+  return mix(OutlineColorWithNewAlpha, CharColor, CharColor.a);
+}
+)";
+
+  DEBUG("Submitting Text Shader");
+  return GLShader::submit("TextShader", kShaderVert, kShaderFrag);
+}
+
+/// Finish Text Shader build and load its locations
+auto load_text_shader(PendingGLShader pending) -> GLShader
+{
+  DEBUG("Loading Text Shader");
+  auto shader = pending.finish();
+  ASSERT(shader);
+  shader->bind();
+  shader->load_attr_loc(GLAttr::MODEL, "aModel");
+  shader->load_attr_loc(GLAttr::TEXRECT, "aTexRect");
+  shader->load_attr_loc(GLAttr::COLOR, "aColor");
+  shader->load_attr_loc(GLAttr::OUTLINE_COLOR, "aOutlineColor");
+  shader->load_attr_loc(GLAttr::OUTLINE_THICKNESS, "aOutlineThickness");
+  shader->load_unif_loc(GLUnif::VIEW, "uView");
+  shader->load_unif_loc(GLUnif::PROJECTION, "uProjection");
+  shader->load_unif_loc(GLUnif::TEXTURE0, "uTexture0");
+  shader->load_unif_loc(GLUnif::SDF_SPREAD, "uSdfSpread");
+  shader->load_unif_loc(GLUnif::DEPTH, "uDepth");
+
+  return std::move(*shader);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "core/gl_shader.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -7,13 +9,34 @@
 
 /// Holds the shaders used by the game
 struct Shaders {
-  GLShader generic_shader;
+  GLShaderVariants generic_shader;
+  GLShader instanced_sprite_shader;
+  GLShader text_shader;
 };
 
 /// Loads all shaders used by the game
 Shaders load_shaders();
 
-/// Load Generic Shader
-/// (supports rendering: Colored objects, Textured objects and BitmapFont text)
-GLShader load_generic_shader();
+/// Submit Generic Shader variants build
+/// (supports rendering: Colored objects, Textured objects and BitmapFont text, one variant each)
+std::vector<PendingGLShader> submit_generic_shader();
+
+/// Finish Generic Shader variants build and load their locations
+GLShaderVariants load_generic_shader(std::vector<PendingGLShader> pending);
+
+/// Submit Instanced Sprite Shader build
+/// (renders instances of a textured quad, each with its own transform, texture rect and tint,
+/// the quad's corners are generated from gl_VertexID, drawn as a 4 vertices triangle strip)
+PendingGLShader submit_instanced_sprite_shader();
+
+/// Finish Instanced Sprite Shader build and load its locations
+GLShader load_instanced_sprite_shader(PendingGLShader pending);
+
+
+/// Submit Text Shader build
+/// (renders batched bitmap or SDF font glyphs, one instance each placed in world space with its text's color and
+/// outline, the glyph quad's corners are generated from gl_VertexID, drawn as a 4 vertices triangle strip)
+PendingGLShader submit_text_shader();
 
+/// Finish Text Shader build and load its locations
+GLShader load_text_shader(PendingGLShader pending);
@@ -1,18 +1,20 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <optional>
 #include <unordered_map>
 
 #include "core/gl_texture.hpp"
 #include "core/res_manager.hpp"
+#include "core/texture_atlas.hpp"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Textures
 
-/// Holds the textures used by the game
-class Textures: public ResManager<std::string, GLTextureRef> {
-  using Base = ResManager<std::string, GLTextureRef>;
+/// Holds the textures used by the game, as whole textures or regions of atlas pages
+class Textures: public ResManager<std::string, TextureRegion> {
+  using Base = ResManager<std::string, TextureRegion>;
 
  public:
   Textures() = default;
@@ -20,10 +22,20 @@ class Textures: public ResManager<std::string, GLTextureRef> {
 
   /// Load a Texture into cache
   template<typename ...Args>
-  auto load(const std::string& texpath, Args&&... args) -> std::optional<GLTextureRef> {
+  auto load(const std::string& texpath, Args&&... args) -> std::optional<TextureRegion> {
     auto tex = load_rgba_texture(texpath, std::forward<Args>(args)...);
     if (!tex) return std::nullopt;
-    return Base::load(texpath, std::make_shared<GLTexture>(std::move(*tex)));
+    const BlendMode blend = tex->blend;
+    return Base::load(texpath, TextureRegion{ .texture = std::make_shared<GLTexture>(std::move(*tex)), .blend = blend });
   }
-};
 
+  /// Load Textures into cache packed together in atlas pages, so sprites using any of them can be drawn in one batch
+  template<typename ...Args>
+  bool pack(const std::vector<std::string>& texpaths, Args&&... args) {
+    auto regions = pack_texture_atlas(texpaths, std::forward<Args>(args)...);
+    if (!regions) return false;
+    for (size_t i = 0; i < texpaths.size(); i++)
+      Base::load(texpaths[i], std::move((*regions)[i]));
+    return true;
+  }
+};